@@ -50,10 +50,7 @@ namespace pdftoedn
     // Coordinates
     std::ostream& Coord::to_edn(std::ostream& o) const
     {
-        util::edn::Vector v(2);
-        v.push(x);
-        v.push(y);
-        o << v;
+        util::output::Writer(o).put('[').number(x).put(' ').number(y).put(']');
         return o;
     }
 
@@ -358,10 +355,12 @@ namespace pdftoedn
     // output a bounding box
     std::ostream& BoundingBox::to_edn(std::ostream& o) const
     {
-        util::edn::Vector v(2);
-        v.push(c1);
-        v.push(c2);
-        o << v;
+        util::output::Writer w(o);
+        w.put('[');
+        c1.to_edn(o);
+        w.put(' ');
+        c2.to_edn(o);
+        w.put(']');
         return o;
     }
 
@@ -21,6 +21,9 @@
 #include <sstream>
 #include <ostream>
 #include <cmath>
+#include <cstring>
+
+#include "util_output.h"
 
 namespace pdftoedn
 {
@@ -51,21 +54,27 @@ namespace pdftoedn
 
 
     // -------------------------------------------------------
-    // edn symbols with a leading ':'
+    // edn symbols with a leading ':'. Symbols only reference their
+    // name so it must have static storage (a string literal) -
+    // construction never allocates
     //
     struct Symbol : public gemable
     {
-        Symbol() =default;
-        Symbol(const char* s) : str(s) {}
-        explicit Symbol(const std::string& s) : str(s) {}
+        Symbol() : str(""), len(0) {}
+        template <size_t N>
+        Symbol(const char (&s)[N]) : str(s), len(N - 1) {}
+        explicit Symbol(const char* s) : str(s), len(std::strlen(s)) {}
+
+        const char* name() const { return str; }
 
         virtual std::ostream& to_edn(std::ostream& o) const {
-            o << ":" << str;
+            util::output::Writer(o).symbol(str, len);
             return o;
         }
 
     private:
-        std::string str;
+        const char* str;
+        size_t len;
     };
 
 
@@ -30,6 +30,7 @@
 #include "text.h"
 #include "graphics.h"
 #include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
 #include "doc_page.h"
 #include "runtime_options.h"
 #include "util.h"
@@ -79,11 +80,11 @@ namespace pdftoedn
     // destructor
     PdfPage::~PdfPage()
     {
-        // pdf text spans & images are tracked as pointers sorted in a
-        // set; there are auto_ptr types that let you manage this but,
-        // for now, we just track them directly as pointer and delete
-        // them at the end
-        util::delete_ptr_container_elems(text_spans);
+        // pdf text spans & images are tracked as pointers (images
+        // sorted in a set); there are auto_ptr types that let you
+        // manage this but, for now, we just track them directly as
+        // pointer and delete them at the end
+        for (const TextSpanEntry& e : text_spans) { delete e.span; }
         util::delete_ptr_container_elems(images);
 
         // everything else is either tracked as pointers in a list /
@@ -182,6 +183,7 @@ namespace pdftoedn
             if (ii != images.end()) {
                 // increase ref count
                 (*ii)->ref();
+                stats.count(StatsTracker::COUNT_IMAGES_CACHED);
                 return true;
             }
         }
@@ -201,6 +203,7 @@ namespace pdftoedn
             res_id = (*ii)->id();
             // increase ref count
             (*ii)->ref();
+            stats.count(StatsTracker::COUNT_IMAGES_CACHED);
             return true;
         }
         return false;
@@ -212,7 +215,8 @@ namespace pdftoedn
     // may be modified due to a transformation. StreamProps refers to
     // the original stream properties of the source image in the PDF
     bool PdfPage::cache_image(intmax_t res_id, const BoundingBox& bbox,
-                              int width, int height,
+                              int width, int height, const ImageCodec& codec,
+                              const ImageOrientation& orientation,
                               const StreamProps& properties,
                               const std::string& data,
                               const std::string& data_md5)
@@ -220,7 +224,10 @@ namespace pdftoedn
         // determine a file name for the image within the resource
         // directory and write it
         std::string img_file_path;
-        if (!pdftoedn::options.get_image_path(res_id, img_file_path)) {
+        bool path_status = (pdftoedn::options.dedup_images() ?
+                            pdftoedn::options.get_image_path(data_md5, codec, img_file_path) :
+                            pdftoedn::options.get_image_path(res_id, codec, img_file_path));
+        if (!path_status) {
             et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE,
                           "failed to determine absolute file path to write image data to disk");
             return false;
@@ -235,7 +242,7 @@ namespace pdftoedn
 
         // image is written. Save info in an ImageData for object
         // output but use the relative path name in the output
-        ImageData* image = new ImageData(res_id, bbox, width, height,
+        ImageData* image = new ImageData(res_id, bbox, width, height, codec, orientation,
                                          properties, data_md5,
                                          pdftoedn::options.get_image_rel_path(img_file_path));
 
@@ -244,6 +251,117 @@ namespace pdftoedn
         return true;
     }
 
+    //
+    // caches an image that is still being encoded so later uses find
+    // it. Returns the path the image data must be written to unless
+    // images are named by their md5
+    bool PdfPage::reserve_image(intmax_t res_id, const BoundingBox& bbox,
+                                const ImageCodec& codec, const ImageOrientation& orientation,
+                                const StreamProps& properties,
+                                std::string& img_file_path)
+    {
+        if (!pdftoedn::options.get_image_path(res_id, codec, img_file_path)) {
+            et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE,
+                          "failed to determine absolute file path to write image data to disk");
+            return false;
+        }
+
+        // size and md5 are set once it's encoded
+        ImageData* image = new ImageData(res_id, bbox, 0, 0, codec, orientation,
+                                         properties, "",
+                                         pdftoedn::options.get_image_rel_path(img_file_path));
+        images.insert( images.end(), image );
+        return true;
+    }
+
+    //
+    // a reserved image was encoded and written
+    void PdfPage::image_encoded(intmax_t res_id, int width, int height,
+                                const std::string& data_md5,
+                                const std::string& img_file_path)
+    {
+        auto ii = std::find_if( images.begin(), images.end(),
+                                [=](const ImageData* i) { return i->equals(res_id); }
+                                );
+        if (ii != images.end()) {
+            (*ii)->set_encoded(width, height, data_md5,
+                               pdftoedn::options.get_image_rel_path(img_file_path));
+        }
+    }
+
+    //
+    // a reserved image failed to encode - remove it and the
+    // references to it that were added in the mean time
+    void PdfPage::drop_image(intmax_t res_id)
+    {
+        auto ii = std::find_if( images.begin(), images.end(),
+                                [=](const ImageData* i) { return i->equals(res_id); }
+                                );
+        if (ii != images.end()) {
+            delete *ii;
+            images.erase(ii);
+        }
+
+        for (auto gi = graphics.begin(); gi != graphics.end(); ) {
+            const PdfImage* img = dynamic_cast<const PdfImage*>(*gi);
+            if (img && img->id() == res_id) {
+                delete *gi;
+                gi = graphics.erase(gi);
+            } else {
+                ++gi;
+            }
+        }
+    }
+
+
+    //
+    // an encoded image's md5 is now known. Inlined images with the
+    // same data that were cached since it was queued (their ids
+    // count down from first_inline_id) are removed and their
+    // references point to it instead
+    void PdfPage::merge_inlined_images(intmax_t res_id, const std::string& data_md5,
+                                       intmax_t first_inline_id)
+    {
+        auto ii = std::find_if( images.begin(), images.end(),
+                                [=](const ImageData* i) { return i->equals(res_id); }
+                                );
+        if (ii == images.end()) {
+            return;
+        }
+        const ImageData* image = *ii;
+
+        for (auto di = images.begin(); di != images.end(); ) {
+            const ImageData* dup = *di;
+            if (dup->id() > first_inline_id || dup->md5() != data_md5) {
+                ++di;
+                continue;
+            }
+
+            // each use of the inlined image would have found the
+            // encoded one
+            image->ref(dup->refs());
+            stats.count(StatsTracker::COUNT_IMAGES_CACHED, dup->refs());
+
+            for (PdfGfxCmd* g : graphics) {
+                PdfImage* img = dynamic_cast<PdfImage*>(g);
+                if (img && img->id() == dup->id()) {
+                    img->set_id(res_id);
+                }
+            }
+
+            // images named by md5 share the file
+            std::string img_file_path;
+            if (!pdftoedn::options.dedup_images() &&
+                pdftoedn::options.get_image_path(dup->id(), dup->image_codec(), img_file_path, false)) {
+                boost::system::error_code ec;
+                boost::filesystem::remove(img_file_path, ec);
+            }
+
+            delete dup;
+            di = images.erase(di);
+        }
+    }
+
 
     //
     // pops the current temporary span and pushes it into the list if
@@ -306,8 +424,9 @@ namespace pdftoedn
             remove_spans_overlapped_by_span( *span );
         }
 #endif
-        // insert it into the list
-        text_spans.insert(text_spans.end(), span);
+        // append it to the list - sorted when the page is finalized
+        text_spans.push_back(TextSpanEntry(span));
+        stats.count(StatsTracker::COUNT_SPANS);
 
         // adjust the overall text bounds if needed
         cur_text.bounds.expand( span_bbox );
@@ -319,23 +438,15 @@ namespace pdftoedn
     // and, if so, removes them
     void PdfPage::remove_spans_overlapped_by_span(const PdfText& pending_span)
     {
-        auto cur_it = text_spans.begin();
+        PdfText::OverlapPred overlaps = pending_span.overlap_predicate();
 
-        // search until no matches are found
-        while (1)
+        for (TextSpanEntry& e : text_spans)
         {
-            auto span_it = std::find_if( cur_it,
-                                         text_spans.end(),
-                                         pending_span.overlap_predicate() );
-
-            if (span_it == text_spans.end()) {
-                break;
+            if (e.span && overlaps(e.span)) {
+                // delete the text span and leave a tombstone
+                delete e.span;
+                e.span = nullptr;
             }
-
-            // delete the text span and erase the container
-            cur_it = std::next(span_it);
-            delete *span_it;
-            text_spans.erase(span_it);
         }
     }
 
@@ -346,15 +457,18 @@ namespace pdftoedn
     void PdfPage::remove_spans_overlapped_by_region(const PdfPath& region)
     {
         BoundingBox path_bbox = region.bounding_box();
-        auto span_it = text_spans.begin();
 
-        while (span_it != text_spans.end())
+        for (TextSpanEntry& e : text_spans)
         {
-            PdfBoxedItem* span = *span_it;
+            PdfText* span = e.span;
+
+            // skip removed spans
+            if (!span) {
+                continue;
+            }
 
             // TODO: re-work rotated text spans to let this work
             if (span->CTM().is_rotated()) {
-                ++span_it;
                 continue;
             }
 
@@ -366,17 +480,14 @@ namespace pdftoedn
             // approx. rules for now. Anything that's covered less
             // than 25% we say is not covered
             if (overlap_ratio < 0.25) {
-                ++span_it;
                 continue;
             }
 
-            auto tmp_it = span_it++;
-
             // anything > 80% is fully covered. Might get some false
             // positives here because the bboxes are approximated
             if (overlap_ratio > 0.8) {
-                delete *tmp_it;
-                text_spans.erase(tmp_it);
+                delete span;
+                e.span = nullptr;
             }
             else {
                 // for ratios between 25% and 80%, check the bbox to
@@ -385,15 +496,12 @@ namespace pdftoedn
                 // assumes horizontal spans so FIX
                 if (sbbox.x_min() < path_bbox.x_min() ||
                     sbbox.x_max() > path_bbox.x_max()) {
-                    PdfText* s = dynamic_cast<PdfText*>(span);
-                    if (s) {
-                        s->whiteout(path_bbox);
-
-                        // if no chars are left, delete it
-                        if (s->length() == 0) {
-                            delete *tmp_it;
-                            text_spans.erase(tmp_it);
-                        }
+                    span->whiteout(path_bbox);
+
+                    // if no chars are left, delete it
+                    if (span->length() == 0) {
+                        delete span;
+                        e.span = nullptr;
                     }
                 }
             }
@@ -407,6 +515,8 @@ namespace pdftoedn
                                 const TextMetrics& metrics, uintmax_t unicode_c,
                                 intmax_t glyph_idx, bool invisible)
     {
+        ++chars_read;
+
         // copy the current text attribs - we'll modify the copy
         // until we know this character gets added
         TextAttribs ta(cur_text.attribs);
@@ -437,18 +547,19 @@ namespace pdftoedn
         // since poppler returns a 0 for horizontal text. If
         // rotated, we use the given height and try to compensate
         // later
-        BoundingBox bbox(x, y, w, (ctm.is_rotated() ? h : -ta.font_size));
+        double char_h = (ctm.is_rotated() ? h : -ta.font_size);
+        BoundingBox bbox(x, y, w, char_h);
 
         ta.invisible = invisible;
         ta.link_idx = inside_link(bbox);
-        PdfChar *c = new PdfChar(bbox, ctm, unicode_c, ta, cur_gfx.attribs,
-                                 metrics, glyph_idx, cur_gfx.clip_path());
+        PdfChar c(x, y, w, char_h, ctm, unicode_c, ta, cur_gfx.capture(),
+                  metrics, glyph_idx, cur_gfx.clip_path());
 
         // check if we've started a span already
         if (cur_text.span)
         {
             // yes, check if we can join them
-            if (!cur_text.span->spans(*c)) {
+            if (!cur_text.span->spans(c)) {
                 // no. push the existing span into the list of
                 // text_spans - this creates a new empty span we'll
                 // append to below
@@ -467,11 +578,7 @@ namespace pdftoedn
 
             // and update the text attribs
             cur_text.attribs = ta;
-            return;
         }
-
-        // did not get appended for some reason so delete it
-        delete c;
     }
 
     //
@@ -488,14 +595,14 @@ namespace pdftoedn
     // update the state's transform matrix
     void PdfPage::update_ctm(const double* CTM)
     {
-        cur_gfx.attribs.update_ctm(PdfTM(CTM));
+        cur_gfx.modify().update_ctm(PdfTM(CTM));
     }
 
     //
     // push the current state into the stack
     void PdfPage::push_gfx_state()
     {
-        cur_gfx.attribs_stack.push( cur_gfx.attribs );
+        cur_gfx.attribs_stack.push( cur_gfx.capture() );
         // std::cerr << "  + pushing gfx attribs: " << std::endl
         //           << cur_gfx.attribs << std::endl;
     }
@@ -505,9 +612,15 @@ namespace pdftoedn
     void PdfPage::pop_gfx_state()
     {
         if (!cur_gfx.attribs_stack.empty()) {
-            cur_gfx.attribs = cur_gfx.attribs_stack.top();
+            const GfxAttribs* saved = cur_gfx.attribs_stack.top();
             cur_gfx.attribs_stack.pop();
 
+            // nothing to do if the state was not modified
+            if (cur_gfx.interned != saved) {
+                cur_gfx.attribs = *saved;
+                cur_gfx.interned = saved;
+            }
+
             // std::cerr << "  - popped gfx attribs. Current state: " << std::endl
             //           << cur_gfx.attribs << std::endl;
         }
@@ -528,7 +641,7 @@ namespace pdftoedn
             line_dash.push_back(pattern[i]);
         }
 
-        cur_gfx.attribs.update_line_dash(line_dash);
+        cur_gfx.modify().update_line_dash(line_dash);
     }
 
     //
@@ -538,12 +651,59 @@ namespace pdftoedn
         // make sure to push the final span
         mark_end_of_text();
 
+        // drop removed spans and put the rest in reading order
+        sort_text_spans();
+
+        stats.count(StatsTracker::COUNT_CHARS, chars_read);
+
         if (pdftoedn::options.include_debug_info()) {
             // report any page font issues
             for (const PdfPage::PageFont* f : fonts) { f->log_font_issues(); }
         }
     }
 
+    //
+    // compacts the text span list, dropping entries for spans that
+    // were removed, and puts it in reading order.
+    //
+    // PdfText::is_positioned_before treats spans whose baselines are
+    // within the first span's threshold as being on the same line;
+    // that is not a strict weak ordering so it can't be handed to a
+    // sort. Instead, spans are walked top to bottom and grouped into
+    // lines, each anchored on its top-most span and that span's
+    // threshold. The final order (line, x, insertion order) is a
+    // total one and matches is_positioned_before wherever that is
+    // consistent
+    void PdfPage::sort_text_spans()
+    {
+        text_spans.erase( std::remove_if( text_spans.begin(), text_spans.end(),
+                                          [](const TextSpanEntry& e) { return (e.span == nullptr); } ),
+                          text_spans.end() );
+
+        if (text_spans.empty()) {
+            return;
+        }
+
+        for (uintmax_t i = 0; i < text_spans.size(); ++i) {
+            text_spans[i].seq = i;
+        }
+
+        std::stable_sort( text_spans.begin(), text_spans.end(), TextSpanEntry::y_lt() );
+
+        uintmax_t line = 0;
+        const TextSpanEntry* anchor = &text_spans.front();
+        for (TextSpanEntry& e : text_spans)
+        {
+            if (e.y_max - anchor->y_max >= anchor->baseline_threshold) {
+                ++line;
+                anchor = &e;
+            }
+            e.line = line;
+        }
+
+        std::sort( text_spans.begin(), text_spans.end(), TextSpanEntry::lt() );
+    }
+
     //
     // searches if a clip path has already been defined to avoid
     // duplicates
@@ -563,8 +723,10 @@ namespace pdftoedn
     // create and add a new path type
     void PdfPage::new_path(GfxState* state, PdfDocPath::Type type, PdfDocPath::EvenOddRule eo_flag)
     {
+        stats.count(StatsTracker::COUNT_PATHS);
+
         // convert the poppler path to our own type
-        PdfDocPath* path = new PdfDocPath(type, cur_gfx.attribs, eo_flag);
+        PdfDocPath* path = new PdfDocPath(type, cur_gfx.capture(), eo_flag);
         Coord c1, c2, c3;
         GfxPath* poppler_path = state->getPath();
 
@@ -622,7 +784,7 @@ namespace pdftoedn
             }
 
             // and set the active clip path
-            cur_gfx.attribs.clip_idx = cur_path_idx;
+            cur_gfx.modify().clip_idx = cur_path_idx;
         }
         else {
             // stroke / fill paths might be clipped
@@ -760,7 +922,7 @@ namespace pdftoedn
 
         // an array for the text spans
         util::edn::Vector text_a(text_spans.size());
-        for (const PdfBoxedItem* t : text_spans) { text_a.push(t); }
+        for (const TextSpanEntry& e : text_spans) { text_a.push(e.span); }
 
         // an array for the graphics with clip paths first
         util::edn::Vector gfx_a(clip_paths.size() + graphics.size());
@@ -819,11 +981,11 @@ namespace pdftoedn
     // current text state. This ensures a Text entry has been
     // allocated and then the character is pushed into it. NOTE:
     // leading whitespace are ignored
-    bool PdfPage::TextState::push_char(PdfChar* const c)
+    bool PdfPage::TextState::push_char(const PdfChar& c)
     {
         if (!span) {
             // if we're trying to insert a space and there's no span, drop it
-            if (c->is_space()) {
+            if (c.is_space()) {
                 return false;
             }
             span = new PdfText;
@@ -844,6 +1006,18 @@ namespace pdftoedn
     }
 
 
+    //
+    // interns the current gfx attribs if they've changed since they
+    // were last captured
+    const GfxAttribs* PdfPage::GraphicsState::capture()
+    {
+        if (!interned) {
+            interned = states.intern(attribs);
+        }
+        return interned;
+    }
+
+
     // ==================================================================
     // page font
     //
@@ -44,7 +44,7 @@ namespace pdftoedn
         // constructor / destructor
         PdfPage(uintmax_t page_number, double page_width, double page_height, intmax_t page_rotation) :
             number(page_number), bbox(0, 0, page_width, page_height), rotation(page_rotation),
-            has_invisible_text(false)
+            has_invisible_text(false), chars_read(0)
         {}
         PdfPage() = delete;
         PdfPage(const PdfPage&) = delete;
@@ -72,10 +72,26 @@ namespace pdftoedn
         bool image_is_cached(intmax_t resource_id) const;
         bool inlined_image_is_cached(const std::string& md5, intmax_t& res_id) const;
         bool cache_image(intmax_t resource_id, const BoundingBox& bbox,
-                         int width, int height,
+                         int width, int height, const ImageCodec& codec,
+                         const ImageOrientation& orientation,
                          const StreamProps& properties,
                          const std::string& data,
                          const std::string& data_md5);
+        // images encoded by a worker are cached before the data is
+        // ready and then either completed or dropped
+        bool reserve_image(intmax_t resource_id, const BoundingBox& bbox,
+                           const ImageCodec& codec, const ImageOrientation& orientation,
+                           const StreamProps& properties,
+                           std::string& img_file_path);
+        void image_encoded(intmax_t resource_id, int width, int height,
+                           const std::string& data_md5,
+                           const std::string& img_file_path);
+        void drop_image(intmax_t resource_id);
+        // inlined images can't be matched against images still being
+        // encoded so duplicates cached while they were are merged
+        // into them once they're done
+        void merge_inlined_images(intmax_t resource_id, const std::string& data_md5,
+                                  intmax_t first_inline_id);
 
         // text-related methods --
         //
@@ -96,24 +112,24 @@ namespace pdftoedn
 
         // update_line_dash: pass by copy to invoke vector= w/ move
         void update_line_dash(int length, const double* pattern, double phase);
-        void clear_line_dash() { cur_gfx.attribs.clear_line_dash(); }
-        void update_line_join(int8_t line_join) { cur_gfx.attribs.line_join = line_join; }
-        void update_line_cap(int8_t line_cap) { cur_gfx.attribs.line_cap = line_cap; }
-        void update_miter_limit(double miter_limit) { cur_gfx.attribs.miter_limit = miter_limit; }
-        void update_line_width(double line_width) { cur_gfx.attribs.update_line_width(line_width); }
+        void clear_line_dash() { cur_gfx.modify().clear_line_dash(); }
+        void update_line_join(int8_t line_join) { cur_gfx.modify().line_join = line_join; }
+        void update_line_cap(int8_t line_cap) { cur_gfx.modify().line_cap = line_cap; }
+        void update_miter_limit(double miter_limit) { cur_gfx.modify().miter_limit = miter_limit; }
+        void update_line_width(double line_width) { cur_gfx.modify().update_line_width(line_width); }
         void update_stroke_color(color_comp_t r, color_comp_t g, color_comp_t b) {
-            cur_gfx.attribs.stroke.color_idx = register_color(r, g, b);
+            cur_gfx.modify().stroke.color_idx = register_color(r, g, b);
         }
-        void update_stroke_opacity(double opacity) { cur_gfx.attribs.stroke.opacity = opacity; }
-        void update_stroke_overprint(bool overprint) { cur_gfx.attribs.stroke.overprint = overprint; }
+        void update_stroke_opacity(double opacity) { cur_gfx.modify().stroke.opacity = opacity; }
+        void update_stroke_overprint(bool overprint) { cur_gfx.modify().stroke.overprint = overprint; }
 
         void update_fill_color(color_comp_t r, color_comp_t g, color_comp_t b) {
-            cur_gfx.attribs.fill.color_idx = register_color(r, g, b);
+            cur_gfx.modify().fill.color_idx = register_color(r, g, b);
         }
-        void update_fill_opacity(double opacity) { cur_gfx.attribs.fill.opacity = opacity; }
-        void update_fill_overprint(bool overprint) { cur_gfx.attribs.fill.overprint = overprint; }
-        void update_overprint_mode(uint8_t mode) { cur_gfx.attribs.overprint_mode = mode; }
-        void update_blend_mode(uint8_t blend_mode) { cur_gfx.attribs.blend_mode = blend_mode; }
+        void update_fill_opacity(double opacity) { cur_gfx.modify().fill.opacity = opacity; }
+        void update_fill_overprint(bool overprint) { cur_gfx.modify().fill.overprint = overprint; }
+        void update_overprint_mode(uint8_t mode) { cur_gfx.modify().overprint_mode = mode; }
+        void update_blend_mode(uint8_t blend_mode) { cur_gfx.modify().blend_mode = blend_mode; }
 
         // images --
         //
@@ -159,6 +175,8 @@ namespace pdftoedn
         BoundingBox bbox;
         intmax_t rotation;
         bool has_invisible_text;
+        // counted locally and added to the stats once per page
+        uintmax_t chars_read;
 
         // resources
         std::stack<const PdfFont*> pending_font;
@@ -167,8 +185,48 @@ namespace pdftoedn
         std::set<pdftoedn::ImageData*, pdftoedn::ImageData::lt> images;
         std::vector<pdftoedn::PdfGlyph *> glyphs;
 
+        // text spans are appended as they are collected and sorted
+        // once when the page is finalized. The position is captured
+        // on insertion so the order does not change if characters
+        // are later whited-out
+        struct TextSpanEntry {
+            explicit TextSpanEntry(pdftoedn::PdfText* const s) :
+                span(s), y_max(s->y_max()), x_min(s->x_min()),
+                baseline_threshold(s->baseline_threshold()),
+                line(0), seq(0)
+            {}
+
+            // orders by y_max only - used to group spans into lines
+            struct y_lt {
+                bool operator()(const TextSpanEntry& e1, const TextSpanEntry& e2) const {
+                    return (e1.y_max < e2.y_max);
+                }
+            };
+
+            // reading order once lines are assigned: line, then x,
+            // then insertion order
+            struct lt {
+                bool operator()(const TextSpanEntry& e1, const TextSpanEntry& e2) const {
+                    if (e1.line != e2.line) {
+                        return (e1.line < e2.line);
+                    }
+                    if (e1.x_min != e2.x_min) {
+                        return (e1.x_min < e2.x_min);
+                    }
+                    return (e1.seq < e2.seq);
+                }
+            };
+
+            pdftoedn::PdfText* span; // nullptr once removed
+            double y_max;
+            double x_min;
+            double baseline_threshold;
+            uintmax_t line;          // set by sort_text_spans
+            uintmax_t seq;
+        };
+
         // data
-        std::multiset<pdftoedn::PdfBoxedItem *, pdftoedn::PdfBoxedItem::lt> text_spans;
+        std::vector<TextSpanEntry> text_spans;
         std::list<pdftoedn::PdfGfxCmd *> graphics;
         std::vector<pdftoedn::PdfDocPath *> clip_paths;
         std::vector<pdftoedn::PdfAnnotLink *> links;
@@ -183,23 +241,31 @@ namespace pdftoedn
             pdftoedn::Bounds bounds;
 
             // helpers
-            bool push_char(pdftoedn::PdfChar* const c);
+            bool push_char(const pdftoedn::PdfChar& c);
             pdftoedn::PdfText* pop_text();
         } cur_text;
 
         // transient state of gfx as collected
         struct GraphicsState {
-            GraphicsState() { }
+            GraphicsState() : interned(nullptr) { }
 
             bool clip_path_set() const { return (attribs.clip_idx != -1); }
             intmax_t clip_path() const { return attribs.clip_idx; }
 
+            // all changes to the current attribs must go through
+            // here so the interned copy is invalidated
+            GfxAttribs& modify() { interned = nullptr; return attribs; }
+            // returns the interned copy of the current attribs
+            const GfxAttribs* capture();
+
             pdftoedn::Bounds bounds;
             GfxAttribs attribs;
+            const GfxAttribs* interned; // attribs' entry in the table, if captured
+            GfxStateTable states;
 
             // track the current gfx state as it is pushed / popped in
             // the PDF
-            std::stack<GfxAttribs> attribs_stack;
+            std::stack<const GfxAttribs*> attribs_stack;
         } cur_gfx;
 
         // helpers
@@ -213,6 +279,7 @@ namespace pdftoedn
         bool insert_pending_span();
         void remove_spans_overlapped_by_span(const PdfText& span);
         void remove_spans_overlapped_by_region(const PdfPath& region);
+        void sort_text_spans();
         intmax_t find_clip_path(PdfDocPath* const path);
 
         // mark end of text object - triggers pushing of any pending spans
@@ -52,6 +52,13 @@ namespace pdftoedn
         // called to process a page
         const PdfPage* page_data() const { return pg_data; }
 
+        // resume support - replayed pages are processed only to
+        // rebuild document-wide state (fonts, inline image ids) so
+        // devices can skip anything else
+        virtual void set_replay_mode(bool /*replay*/) { }
+        virtual int next_inline_image_id() const { return 0; }
+        virtual void set_next_inline_image_id(int /*id*/) { }
+
         // some default values
         // Does this device use upside-down coordinates?
         // (Upside-down means (0,0) is the top left corner of the page.)
@@ -25,6 +25,7 @@
 #include "font_engine.h"
 #include "pdf_font_source.h"
 #include "pdf_output_dev.h"
+#include "pdf_stats_tracker.h"
 #include "font.h"
 #include "text.h"
 #include "util_debug.h"
@@ -98,6 +99,8 @@ namespace pdftoedn
     // looks up a font in the Font Cache.. if not found, allocates an entry
     PdfFont* FontEngine::load_font(const GfxFont* gfx_font)
     {
+        StatsTracker::Timer t(StatsTracker::PHASE_FONT_LOAD);
+
         const GfxFontLoc *gfx_font_loc = nullptr;
         FontSource* font_src = nullptr;
 
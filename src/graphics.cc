@@ -198,6 +198,40 @@ namespace pdftoedn
                 );
     }
 
+    //
+    // full comparison, including the CTM and line dash
+    bool GfxAttribs::is_identical(const GfxAttribs& a2) const
+    {
+        return (
+                equals(a2) &&
+                (overprint_mode == a2.overprint_mode) &&
+                (clip_idx == a2.clip_idx) &&
+                (ctm == a2.ctm) &&
+                (l_dash == a2.l_dash)
+                );
+    }
+
+    //
+    // hash over the fields most likely to differ between states
+    size_t GfxAttribs::hash() const
+    {
+        std::hash<double> dh;
+        size_t h = dh(l_width);
+        auto combine = [&h](size_t v) { h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2); };
+
+        combine(std::hash<intmax_t>()(stroke.color_idx));
+        combine(std::hash<intmax_t>()(fill.color_idx));
+        combine(dh(stroke.opacity));
+        combine(dh(fill.opacity));
+        combine(std::hash<intmax_t>()(clip_idx));
+        combine(dh(ctm.a()));
+        combine(dh(ctm.d()));
+        combine(dh(ctm.e()));
+        combine(dh(ctm.f()));
+        combine(l_dash.size());
+        return h;
+    }
+
     //
     // transform the line wdith using the state's CTM for output
     double GfxAttribs::line_width() const
@@ -247,6 +281,31 @@ namespace pdftoedn
     }
 
 
+    // -------------------------------------------------------
+    // interned gfx states
+    //
+
+    //
+    // returns the table's entry for the given state, adding it if
+    // not yet present
+    const GfxAttribs* GfxStateTable::intern(const GfxAttribs& attribs)
+    {
+        size_t h = attribs.hash();
+        auto range = lookup.equal_range(h);
+
+        for (auto ii = range.first; ii != range.second; ++ii) {
+            if (ii->second->is_identical(attribs)) {
+                return ii->second;
+            }
+        }
+
+        states.push_back(attribs);
+        const GfxAttribs* entry = &states.back();
+        lookup.insert( std::make_pair(h, entry) );
+        return entry;
+    }
+
+
     // -------------------------------------------------------
     // path building
     //
@@ -411,7 +470,7 @@ namespace pdftoedn
         }
 
         // if fill or stroke, are attribs equal?
-        if (path_type != PdfDocPath::CLIP && attribs != p2.attribs) {
+        if (path_type != PdfDocPath::CLIP && attribs != p2.attribs && *attribs != *p2.attribs) {
             /*            std::cerr << "  * different attribs" << std::endl
                  << "    " << attribs << std::endl
                  << "    " << p2.attribs << std::endl;*/
@@ -484,31 +543,31 @@ namespace pdftoedn
             if (path_type == STROKE)
             {
                 // stroke attributes
-                if (attribs.stroke.color_idx != -1) {
-                    attribs_h.push( GfxAttribs::SYMBOL_STROKE_COLOR_IDX, attribs.stroke.color_idx );
+                if (attribs->stroke.color_idx != -1) {
+                    attribs_h.push( GfxAttribs::SYMBOL_STROKE_COLOR_IDX, attribs->stroke.color_idx );
 
-                    if (attribs.stroke.opacity < 1.0) {
-                        attribs_h.push( GfxAttribs::SYMBOL_STROKE_OPACITY, attribs.stroke.opacity );
+                    if (attribs->stroke.opacity < 1.0) {
+                        attribs_h.push( GfxAttribs::SYMBOL_STROKE_OPACITY, attribs->stroke.opacity );
                     }
 
                     // line width & miter limit
-                    attribs_h.push( GfxAttribs::SYMBOL_LINE_WIDTH, attribs.line_width() );
-                    attribs_h.push( GfxAttribs::SYMBOL_MITER_LIMIT, attribs.miter_limit );
+                    attribs_h.push( GfxAttribs::SYMBOL_LINE_WIDTH, attribs->line_width() );
+                    attribs_h.push( GfxAttribs::SYMBOL_MITER_LIMIT, attribs->miter_limit );
 
                     // translate the line cap:
                     // 0 -> butt, 1 -> round, 2 -> square
-                    if (attribs.line_cap != -1 && attribs.line_cap < GfxAttribs::LINE_CAP_STYLE_COUNT) {
-                        attribs_h.push( GfxAttribs::SYMBOL_LINE_CAP, GfxAttribs::SYMBOL_LINE_CAP_STYLE[attribs.line_cap] );
+                    if (attribs->line_cap != -1 && attribs->line_cap < GfxAttribs::LINE_CAP_STYLE_COUNT) {
+                        attribs_h.push( GfxAttribs::SYMBOL_LINE_CAP, GfxAttribs::SYMBOL_LINE_CAP_STYLE[attribs->line_cap] );
                     }
 
                     // translate the line join:
                     // 0 -> miter, 1 -> round, 2 -> bevel
-                    if (attribs.line_join != -1 && attribs.line_join < GfxAttribs::LINE_JOIN_STYLE_COUNT) {
-                        attribs_h.push( GfxAttribs::SYMBOL_LINE_JOIN, GfxAttribs::SYMBOL_LINE_JOIN_STYLE[attribs.line_join] );
+                    if (attribs->line_join != -1 && attribs->line_join < GfxAttribs::LINE_JOIN_STYLE_COUNT) {
+                        attribs_h.push( GfxAttribs::SYMBOL_LINE_JOIN, GfxAttribs::SYMBOL_LINE_JOIN_STYLE[attribs->line_join] );
                     }
 
                     // line dash
-                    std::vector<double> xformed_dash = attribs.line_dash();
+                    std::vector<double> xformed_dash = attribs->line_dash();
                     if (!xformed_dash.empty()) {
                         util::edn::Vector dash_a(xformed_dash.size());
                         for (double d : xformed_dash) {
@@ -518,31 +577,31 @@ namespace pdftoedn
                     }
 
                     // overprint
-                    if (attribs.stroke.overprint && attribs.overprint_mode < GfxAttribs::OVERPRINT_MODE_COUNT) {
-                        attribs_h.push( GfxAttribs::SYMBOL_STROKE_OVERPRINT, GfxAttribs::SYMBOL_OVERPRINT_MODE_TYPES[ attribs.overprint_mode ] );
+                    if (attribs->stroke.overprint && attribs->overprint_mode < GfxAttribs::OVERPRINT_MODE_COUNT) {
+                        attribs_h.push( GfxAttribs::SYMBOL_STROKE_OVERPRINT, GfxAttribs::SYMBOL_OVERPRINT_MODE_TYPES[ attribs->overprint_mode ] );
                     }
                 }
             }
             else {
                 // FILL attributes
-                if (attribs.fill.color_idx != -1) {
-                    attribs_h.push( GfxAttribs::SYMBOL_FILL_COLOR_IDX, attribs.fill.color_idx );
+                if (attribs->fill.color_idx != -1) {
+                    attribs_h.push( GfxAttribs::SYMBOL_FILL_COLOR_IDX, attribs->fill.color_idx );
 
-                    if (attribs.fill.opacity < 1.0) {
-                        attribs_h.push( GfxAttribs::SYMBOL_FILL_OPACITY, attribs.fill.opacity );
+                    if (attribs->fill.opacity < 1.0) {
+                        attribs_h.push( GfxAttribs::SYMBOL_FILL_OPACITY, attribs->fill.opacity );
                     }
 
                     // overprint
-                    if (attribs.fill.overprint && attribs.overprint_mode < GfxAttribs::OVERPRINT_MODE_COUNT) {
-                        attribs_h.push( GfxAttribs::SYMBOL_FILL_OVERPRINT, GfxAttribs::SYMBOL_OVERPRINT_MODE_TYPES[ attribs.overprint_mode ] );
+                    if (attribs->fill.overprint && attribs->overprint_mode < GfxAttribs::OVERPRINT_MODE_COUNT) {
+                        attribs_h.push( GfxAttribs::SYMBOL_FILL_OVERPRINT, GfxAttribs::SYMBOL_OVERPRINT_MODE_TYPES[ attribs->overprint_mode ] );
                     }
                 }
             }
 
             // blend mode
-            if (attribs.blend_mode != GfxAttribs::NORMAL_BLEND &&
-                attribs.blend_mode < GfxAttribs::BLEND_MODE_COUNT) {
-                attribs_h.push( GfxAttribs::SYMBOL_BLEND_MODE, GfxAttribs::SYMBOL_BLEND_MODE_TYPES[attribs.blend_mode] );
+            if (attribs->blend_mode != GfxAttribs::NORMAL_BLEND &&
+                attribs->blend_mode < GfxAttribs::BLEND_MODE_COUNT) {
+                attribs_h.push( GfxAttribs::SYMBOL_BLEND_MODE, GfxAttribs::SYMBOL_BLEND_MODE_TYPES[attribs->blend_mode] );
             }
         }
         return attribs_h;
@@ -23,6 +23,8 @@
 #include <cstdlib>
 #include <list>
 #include <vector>
+#include <deque>
+#include <unordered_map>
 #include "base_types.h"
 
 namespace pdftoedn
@@ -216,6 +218,10 @@ namespace pdftoedn
 
         bool operator!=(const GfxAttribs& a2) const { return !equals(a2); }
 
+        // unlike operator!=, these take all fields into account
+        bool is_identical(const GfxAttribs& a2) const;
+        size_t hash() const;
+
         // data
         StrokeFill stroke;
         StrokeFill fill;
@@ -248,6 +254,27 @@ namespace pdftoedn
     };
 
 
+    // -------------------------------------------------------
+    // table of interned graphics states. Entries are immutable and
+    // live as long as the table so they are shared by pointer;
+    // identical states map to the same entry
+    //
+    class GfxStateTable
+    {
+    public:
+        GfxStateTable() { }
+        GfxStateTable(const GfxStateTable&) = delete;
+        GfxStateTable& operator=(const GfxStateTable&) = delete;
+
+        const GfxAttribs* intern(const GfxAttribs& attribs);
+        uintmax_t size() const { return states.size(); }
+
+    private:
+        std::deque<GfxAttribs> states;
+        std::unordered_multimap<size_t, const GfxAttribs*> lookup;
+    };
+
+
     // -------------------------------------------------------
     // path found in PDF content. Carries graphic attribs
     //
@@ -275,7 +302,7 @@ namespace pdftoedn
 
         // constructor
         PdfDocPath(Type doc_path_type,
-                   const GfxAttribs& gfx_attribs,
+                   const GfxAttribs* gfx_attribs,
                    EvenOddRule even_odd_flag) :
             path_type(doc_path_type),
             attribs(gfx_attribs),
@@ -297,7 +324,7 @@ namespace pdftoedn
 
     protected:
         Type path_type;
-        GfxAttribs attribs;
+        const GfxAttribs* attribs; // interned in the page's GfxStateTable
         EvenOddRule even_odd; // applies only to fill & clip
 
         // if this is a CLIP Path, this is the id to be used in
@@ -79,11 +79,17 @@ namespace pdftoedn
     const pdftoedn::Symbol ImageData::SYMBOL_WIDTH            = "width";
     const pdftoedn::Symbol ImageData::SYMBOL_HEIGHT           = "height";
     const pdftoedn::Symbol ImageData::SYMBOL_MD5              = "md5";
+    const pdftoedn::Symbol ImageData::SYMBOL_CODEC            = "codec";
     const pdftoedn::Symbol ImageData::SYMBOL_IMAGE_PATH       = "image_path";
     const pdftoedn::Symbol ImageData::SYMBOL_STREAM_PROPS     = "props";
 
     const pdftoedn::Symbol PdfImage::SYMBOL_TYPE_IMAGE        = "image";
 
+    const pdftoedn::Symbol ImageOrientation::SYMBOL           = "orientation";
+    const pdftoedn::Symbol ImageOrientation::SYMBOL_ROTATE    = "rotate";
+    const pdftoedn::Symbol ImageOrientation::SYMBOL_FLIP_H    = "flip_h";
+    const pdftoedn::Symbol ImageOrientation::SYMBOL_FLIP_V    = "flip_v";
+
     // =============================================
     // PDF image stream properties
     //
@@ -181,13 +187,17 @@ namespace pdftoedn
     //
     std::ostream& ImageData::to_edn(std::ostream& o) const
     {
-        util::edn::Hash image_h(7);
+        util::edn::Hash image_h(9);
 
         image_h.push( BoundingBox::SYMBOL, bbox );
         image_h.push( SYMBOL_INSTANCE_COUNT, ref_count );
         image_h.push( SYMBOL_WIDTH, width );
         image_h.push( SYMBOL_HEIGHT, height );
         image_h.push( SYMBOL_MD5, blob_md5 );
+        image_h.push( SYMBOL_CODEC, pdftoedn::Symbol(codec.name()) );
+        if (orientation.is_set()) {
+            image_h.push( ImageOrientation::SYMBOL, &orientation );
+        }
         image_h.push( SYMBOL_STREAM_PROPS, &stream_props );
         image_h.push( SYMBOL_IMAGE_PATH, file_name );
 
@@ -197,6 +207,28 @@ namespace pdftoedn
     }
 
 
+    // =============================================
+    // transformations left to the consumer
+    //
+    std::ostream& ImageOrientation::to_edn(std::ostream& o) const
+    {
+        util::edn::Hash orientation_h(3);
+
+        if (rotation != 0) {
+            orientation_h.push( SYMBOL_ROTATE, rotation );
+        }
+        if (flip_h) {
+            orientation_h.push( SYMBOL_FLIP_H, true );
+        }
+        if (flip_v) {
+            orientation_h.push( SYMBOL_FLIP_V, true );
+        }
+
+        o << orientation_h;
+        return o;
+    }
+
+
     // =============================================
     // PDF image class
     //
@@ -24,6 +24,7 @@
 #include "base_types.h"
 #include "color.h"
 #include "graphics.h"
+#include "runtime_options.h"
 
 namespace pdftoedn
 {
@@ -162,6 +163,30 @@ namespace pdftoedn
     };
 
 
+    // -------------------------------------------------------
+    // orthogonal rotation (clockwise, in degrees) and flips to be
+    // applied, in that order, to image data written without being
+    // transformed
+    //
+    struct ImageOrientation : public gemable
+    {
+        ImageOrientation() : rotation(0), flip_h(false), flip_v(false) { }
+
+        bool is_set() const { return (rotation != 0 || flip_h || flip_v); }
+
+        virtual std::ostream& to_edn(std::ostream& o) const;
+
+        int rotation;
+        bool flip_h;
+        bool flip_v;
+
+        static const pdftoedn::Symbol SYMBOL;
+        static const pdftoedn::Symbol SYMBOL_ROTATE;
+        static const pdftoedn::Symbol SYMBOL_FLIP_H;
+        static const pdftoedn::Symbol SYMBOL_FLIP_V;
+    };
+
+
     // -------------------------------------------------------
     // pdf image data blob management - for caching image data that
     // may be used several times in a doc
@@ -174,12 +199,16 @@ namespace pdftoedn
         ImageData(intmax_t resource_id,
                   const BoundingBox& b,
                   int img_width, int img_height,
+                  const ImageCodec& img_codec,
+                  const ImageOrientation& img_orientation,
                   const StreamProps& props,
                   const std::string& img_data_md5,
                   const std::string& filename) :
             res_id(resource_id),
             bbox(b),
             width(img_width), height(img_height),
+            codec(img_codec),
+            orientation(img_orientation),
             stream_props(props),
             file_name(filename),
             blob_md5(img_data_md5),
@@ -189,9 +218,21 @@ namespace pdftoedn
         // accessors
         intmax_t id() const { return res_id; }
         const std::string& md5() const { return blob_md5; }
-        void ref() const { ref_count++; }
+        const ImageCodec& image_codec() const { return codec; }
+        void ref(uintmax_t count = 1) const { ref_count += count; }
+        uintmax_t refs() const { return ref_count; }
         bool equals(int id) const { return (res_id == id); }
 
+        // images encoded on a worker thread are cached before their
+        // final size, md5 and (with --dedup_images) file are known
+        void set_encoded(int img_width, int img_height, const std::string& img_data_md5,
+                         const std::string& filename) {
+            width = img_width;
+            height = img_height;
+            blob_md5 = img_data_md5;
+            file_name = filename;
+        }
+
         virtual std::ostream& to_edn(std::ostream& o) const;
 
         static const pdftoedn::Symbol SYMBOL_ID;
@@ -199,6 +240,7 @@ namespace pdftoedn
         static const pdftoedn::Symbol SYMBOL_WIDTH;
         static const pdftoedn::Symbol SYMBOL_HEIGHT;
         static const pdftoedn::Symbol SYMBOL_MD5;
+        static const pdftoedn::Symbol SYMBOL_CODEC;
         static const pdftoedn::Symbol SYMBOL_IMAGE_PATH;
         static const pdftoedn::Symbol SYMBOL_STREAM_PROPS;
 
@@ -214,6 +256,8 @@ namespace pdftoedn
         BoundingBox bbox;
         uintmax_t width;
         uintmax_t height;
+        ImageCodec codec;
+        ImageOrientation orientation;
         StreamProps stream_props;
         std::string file_name;
         std::string blob_md5;
@@ -238,6 +282,8 @@ namespace pdftoedn
             bbox(b)
         {  }
 
+        intmax_t id() const { return res_id; }
+        void set_id(intmax_t resource_id) { res_id = resource_id; }
         void set_clip_id(intmax_t clip_id) { clip_path_id = clip_id; }
 
         virtual std::ostream& to_edn(std::ostream& o) const;
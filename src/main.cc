@@ -20,6 +20,9 @@
 #include <iostream>
 #include <fstream>
 #include <clocale>
+#include <memory>
+#include <algorithm>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -32,11 +35,13 @@
 #endif
 #include "base_types.h"
 #include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
 #include "pdf_reader.h"
 #include "runtime_options.h"
 #include "font_maps.h"
 #include "util_edn.h"
 #include "util_fs.h"
+#include "util_output.h"
 #include "util_xform.h"
 #include "util_versions.h"
 
@@ -46,6 +51,9 @@ namespace pdftoedn {
     // task-level error handler for poppler errors
     pdftoedn::ErrorTracker et;
 
+    // per-phase timings and counters (--stats)
+    pdftoedn::StatsTracker stats;
+
     // run-time options passed as args
     pdftoedn::Options options;
 
@@ -54,6 +62,13 @@ namespace pdftoedn {
 
 } // namespace
 
+// output buffer size limits (in KB)
+static const uintmax_t MIN_OUTPUT_BUFFER_KB = 4;
+static const uintmax_t MAX_OUTPUT_BUFFER_KB = 64 * 1024;
+
+// upper limit for --image_workers
+static const uintmax_t MAX_IMAGE_WORKERS = 64;
+
 std::ostream& progversion(std::ostream& o, const char* prog_name)
 {
     o << boost::filesystem::basename(prog_name) << " "
@@ -72,8 +87,14 @@ int main(int argc, char** argv)
 
     // parse the options
     pdftoedn::Options::Flags flags = { false };
-    std::string pdf_filename, pdf_owner_password, pdf_user_password, edn_output_filename, font_map_file;
+    pdftoedn::Options::Settings settings;
+    std::string pdf_filename, pdf_owner_password, pdf_user_password, edn_output_filename, font_map_file, stats_format;
     intmax_t page_number = -1;
+    uintmax_t output_buffer_kb = pdftoedn::util::output::Sink::DEFAULT_BUFFER_SIZE / 1024;
+    std::string compress_spec;
+    uintmax_t image_memory_limit_mb = 0;
+
+    settings.image_workers = std::min<uintmax_t>(std::thread::hardware_concurrency(), MAX_IMAGE_WORKERS);
 
     try
     {
@@ -92,6 +113,8 @@ int main(int argc, char** argv)
              "Include additional debug metadata in output.")
             ("force,f",             po::bool_switch(&flags.force_output_write),
              "Overwrite output file if it exists.")
+            ("mmap_input,M",        po::bool_switch(&flags.mmap_input),
+             "Memory-map the input PDF instead of reading it through buffered file I/O. Falls back to regular reads if the file can't be mapped.")
             ("invisible_text,i",    po::bool_switch(&flags.include_invisible_text),
              "Include invisible text in output (for use with OCR'd documents).")
             ("write_doc_edn_only,d", po::bool_switch(&flags.edn_output_only),
@@ -102,20 +125,50 @@ int main(int argc, char** argv)
              "Extract only text data.")
             ("graphics_only,G",     po::bool_switch(&flags.gfx_output_only),
              "Extract only graphics data.")
+            ("shard_pages,S",       po::bool_switch(&flags.shard_pages),
+             "Write the meta and each page to separate files in the folder given as the output file instead of a single EDN file.")
+            ("resume,R",            po::bool_switch(&flags.resume),
+             "Use with -S to resume an interrupted run. Pages already written to the output folder are skipped.")
+            ("image_passthrough",   po::bool_switch(&flags.image_passthrough),
+             "Write JPEG and JPEG 2000 images as they are stored in the document when their colors don't need converting. Orthogonal rotations and flips are recorded in the image's :orientation instead of being applied.")
+            ("dedup_images",        po::bool_switch(&flags.dedup_images),
+             "Name image files by the MD5 of their data so identical images share a single file. Files already in the image directory are not written again so documents extracted to the same --image_dir share them too.")
             ("omit_outline,O",      po::bool_switch(&flags.omit_outline),
              "Don't extract outline data.")
             ("font_map_file,m",     po::value<std::string>(&font_map_file),
              "JSON font mapping configuration file to use for this run.")
             ("page_number,p",       po::value<intmax_t>(&page_number),
              "Extract data for only this page.")
+            ("pages",               po::value<std::string>(),
+             "Extract data for only these pages: a list of 0-indexed page numbers and ranges (e.g., '0-4,9,19-'), or '@file' to read the list from a file.")
+            ("stats",               po::value<std::string>(&stats_format),
+             "Collect per-page timings and counters and write them in the given format ('json') to a sidecar file next to the output. Also included in the output if -D is set.")
+            ("output_buffer_size",  po::value<uintmax_t>(&output_buffer_kb),
+             "Size (in KB) of the buffer used to write output. Defaults to 1024.")
+            ("compress",            po::value<std::string>(),
+             "Compress the output as it is written using the given format ('gzip' or 'zstd') and optional level (e.g., 'zstd:19').")
+            ("image_workers",       po::value<uintmax_t>(&settings.image_workers),
+             "Number of threads used to encode and write images. Use 0 to encode them while pages are read. Defaults to the number of CPU cores.")
+            ("image_codec",         po::value<std::string>(),
+             "Format to write images in: 'png_fast', 'png', 'png_best', 'qoi' or 'webp_lossless'. Defaults to 'png'. Images rotated by an arbitrary angle are always written as PNGs.")
+            ("max_image_dpi",       po::value<uintmax_t>(&settings.max_image_dpi),
+             "Downsample images displayed at a higher resolution than this (in dots per inch) before encoding them.")
+            ("image_memory_limit",  po::value<uintmax_t>(&image_memory_limit_mb),
+             "Size (in MB) above which the pixels of an image are kept in a memory-mapped temporary file and its encoded data is written straight to disk instead of being held in memory. Images that don't fit in the file system are kept in memory.")
+            ("scratch_dir",         po::value<std::string>(&settings.scratch_dir),
+             "Directory for the temporary files used by --image_memory_limit. Defaults to the image directory or, with -d, the output file's directory. Should not be memory-backed (e.g., tmpfs).")
+            ("image_dir",           po::value<std::string>(&settings.image_dir),
+             "Directory to write images to instead of one named after the output file. Required when writing output to stdout.")
+            ("image_cache",         po::value<std::string>(&settings.image_cache_dir),
+             "Directory where images are cached by a fingerprint of their undecoded data so later uses, in this or other runs, are copied instead of decoded and encoded again.")
             ("owner_password,t",    po::value<std::string>(&pdf_owner_password),
              "PDF owner password if document is encrypted.")
             ("user_password,u",     po::value<std::string>(&pdf_user_password),
              "PDF user password if document is encrypted.")
             ("output_file,o",       po::value<std::string>(&edn_output_filename)->required(),
-             "REQUIRED: Destination file (.edn) to write output to.")
+             "REQUIRED: Destination file (.edn) to write output to. Use '-' to write to stdout.")
             ("filename",            po::value<std::string>(&pdf_filename)->required(),
-             "REQUIRED: PDF document to process (--filename flag is optional when the arg is passed last).")
+             "REQUIRED: PDF document to process (--filename flag is optional when the arg is passed last). Use '-' to read from stdin.")
             ;
 
         po::positional_options_description po_desc;
@@ -155,6 +208,52 @@ int main(int argc, char** argv)
                     return pdftoedn::ErrorTracker::CODE_INIT_ERROR;
                 }
             }
+            if (vm.count("pages")) {
+                if (vm.count("page_number")) {
+                    throw std::logic_error("Can't select both a page number and a page list.");
+                }
+                // throws if invalid
+                settings.pages = pdftoedn::PageRanges::parse(vm["pages"].as<std::string>());
+            }
+            if (vm.count("stats")) {
+                if (vm["stats"].as<std::string>() != "json") {
+                    throw std::logic_error("Unsupported stats format '" + vm["stats"].as<std::string>() + "' (only 'json' is supported).");
+                }
+                flags.collect_stats = true;
+            }
+            if (vm.count("output_buffer_size")) {
+                uintmax_t kb = vm["output_buffer_size"].as<uintmax_t>();
+                if (kb < MIN_OUTPUT_BUFFER_KB || kb > MAX_OUTPUT_BUFFER_KB) {
+                    std::stringstream err;
+                    err << "Output buffer size must be between " << MIN_OUTPUT_BUFFER_KB
+                        << " and " << MAX_OUTPUT_BUFFER_KB << " KB.";
+                    throw std::logic_error(err.str());
+                }
+            }
+            if (vm.count("image_workers") && vm["image_workers"].as<uintmax_t>() > MAX_IMAGE_WORKERS) {
+                std::stringstream err;
+                err << "Number of image workers must be between 0 and " << MAX_IMAGE_WORKERS << ".";
+                throw std::logic_error(err.str());
+            }
+            if (vm.count("max_image_dpi") && vm["max_image_dpi"].as<uintmax_t>() == 0) {
+                throw std::logic_error("Maximum image DPI must be greater than 0.");
+            }
+            if (vm.count("image_memory_limit") && vm["image_memory_limit"].as<uintmax_t>() == 0) {
+                throw std::logic_error("Image memory limit must be greater than 0.");
+            }
+            if (vm.count("image_codec")) {
+                // throws if invalid
+                settings.image_codec = pdftoedn::ImageCodec::parse(vm["image_codec"].as<std::string>());
+            }
+            if (vm.count("compress")) {
+                // throws if the format or level are not valid
+                compress_spec = vm["compress"].as<std::string>();
+                std::unique_ptr<pdftoedn::util::output::Compressor> c(pdftoedn::util::output::Compressor::create(compress_spec));
+            }
+            if (vm.count("resume") && vm["resume"].as<bool>() &&
+                !(vm.count("shard_pages") && vm["shard_pages"].as<bool>())) {
+                throw std::logic_error("Resuming (-R) requires page shards (-S).");
+            }
             if (vm.count("text_only") && vm["text_only"].as<bool>() &&
                 vm.count("graphics_only") && vm["graphics_only"].as<bool>()) {
                 throw std::logic_error("Can't select both 'text only' and 'graphics only' options.");
@@ -180,19 +279,29 @@ int main(int argc, char** argv)
     try
     {
         // expand the paths if they start with ~
+        settings.image_dir = pdftoedn::util::fs::expand_path(settings.image_dir);
+        settings.image_cache_dir = pdftoedn::util::fs::expand_path(settings.image_cache_dir);
+        settings.scratch_dir = pdftoedn::util::fs::expand_path(settings.scratch_dir);
+        settings.image_memory_limit = image_memory_limit_mb * 1024 * 1024;
+
         pdftoedn::options = pdftoedn::Options(pdftoedn::util::fs::expand_path(pdf_filename),
                                               pdf_owner_password,
                                               pdf_user_password,
                                               pdftoedn::util::fs::expand_path(edn_output_filename),
                                               font_map_file,
                                               flags,
-                                              (page_number >= 0 ? page_number : -1));
+                                              (page_number >= 0 ? page_number : -1),
+                                              settings);
     }
     catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
         return pdftoedn::ErrorTracker::CODE_INIT_ERROR;
     }
 
+    if (pdftoedn::options.collect_stats()) {
+        pdftoedn::stats.enable();
+    }
+
     // init support libs if needed
     pdftoedn::util::xform::init_transform_lib();
 
@@ -209,26 +318,72 @@ int main(int argc, char** argv)
         // the outline
         pdftoedn::PDFReader doc_reader;
 
-        std::ofstream output;
-        output.open(pdftoedn::options.edn_filename().c_str());
+        // output is written as many small pieces so it goes
+        // through a large buffer
+        auto make_sink = [&]() {
+            pdftoedn::util::output::Sink* sink = new pdftoedn::util::output::Sink(output_buffer_kb * 1024);
+            if (!compress_spec.empty()) {
+                sink->set_compressor(pdftoedn::util::output::Compressor::create(compress_spec));
+            }
+            return sink;
+        };
+
+        if (pdftoedn::options.shard_pages()) {
+            // write the meta and pages to separate files
+            std::string file_ext;
+            if (!compress_spec.empty()) {
+                std::unique_ptr<pdftoedn::util::output::Compressor> c(pdftoedn::util::output::Compressor::create(compress_spec));
+                file_ext = c->file_ext();
+            }
+
+            doc_reader.write_shards(pdftoedn::options.edn_filename(), file_ext,
+                                    [&](const std::string& filename) {
+                                        std::unique_ptr<pdftoedn::util::output::Sink> sink(make_sink());
+                                        return (sink->open(filename) ? sink.release() : nullptr);
+                                    });
+        }
+        else {
+            std::unique_ptr<pdftoedn::util::output::Sink> sink(make_sink());
+
+            if (pdftoedn::options.edn_to_stdout()) {
+                sink->open_stdout();
+            } else if (!sink->open(pdftoedn::options.edn_filename())) {
+                std::stringstream err;
+                err << pdftoedn::options.edn_filename() << "Cannot open file for write";
+                throw pdftoedn::invalid_file(err.str());
+            }
+
+            // write the document data
+            std::ostream output(sink.get());
+            output << doc_reader;
 
-        if (!output.is_open()) {
-            std::stringstream err;
-            err << pdftoedn::options.edn_filename() << "Cannot open file for write";
-            throw pdftoedn::invalid_file(err.str());
+            // done
+            if (!sink->close()) {
+                std::stringstream err;
+                err << "Error writing output to "
+                    << (pdftoedn::options.edn_to_stdout() ? "stdout" : pdftoedn::options.edn_filename());
+                throw pdftoedn::invalid_file(err.str());
+            }
         }
 
-        // write the document data
-        output << doc_reader;
+        // write the stats sidecar if requested
+        if (pdftoedn::stats.is_enabled()) {
+            std::ofstream stats_output(pdftoedn::options.stats_filename().c_str());
 
-        // done
-        output.close();
+            if (!stats_output.is_open()) {
+                std::stringstream err;
+                err << pdftoedn::options.stats_filename() << " Cannot open stats file for write";
+                throw pdftoedn::invalid_file(err.str());
+            }
+            pdftoedn::stats.to_json(stats_output);
+        }
 
         // set the exit code based on the logged errors
         status = pdftoedn::et.exit_code();
 
     } catch (std::exception& e) {
-        std::cout << e.what() << std::endl;
+        // don't mix errors with the output if it is going to stdout
+        (pdftoedn::options.edn_to_stdout() ? std::cerr : std::cout) << e.what() << std::endl;
         status = pdftoedn::ErrorTracker::CODE_INIT_ERROR;
     }
 
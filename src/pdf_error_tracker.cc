@@ -176,6 +176,8 @@ namespace pdftoedn
             return;
         }
 
+        std::lock_guard<std::mutex> guard(log_lock);
+
         // check if it's already been logged
         if (std::any_of( errors.begin(), errors.end(),
                          [&](const error* err) { return (err->matches(e, module, msg)); }
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <list>
+#include <mutex>
 #include <stdexcept>
 #include <poppler/Error.h>
 #include "base_types.h"
@@ -27,7 +28,8 @@
 namespace pdftoedn
 {
     // ----------------------------------
-    //
+    // errors can be logged from image worker threads so logging is
+    // serialized. Everything else is only used by the main thread
     //
     struct ErrorTracker : public gemable {
         // runtime error codes - these map to enums in poppler/Error.h
@@ -156,6 +158,7 @@ namespace pdftoedn
         uint8_t exit_code_flags;
         std::list<error *> errors;
         std::list<error_type> ignore_errors;
+        std::mutex log_lock;
 
         void set_error_code(error_type e);
         bool error_muted(error_type e) const;
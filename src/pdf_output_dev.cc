@@ -22,7 +22,10 @@
 
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <assert.h>
+#include <boost/filesystem.hpp>
 
 #include <poppler/Error.h>
 #include <poppler/Object.h>
@@ -35,7 +38,11 @@
 #include "doc_page.h"
 #include "color.h"
 #include "graphics.h"
+#include "pdf_stats_tracker.h"
+#include "util.h"
 #include "util_encode.h"
+#include "util_fs.h"
+#include "util_image_cache.h"
 #include "util_xform.h"
 #include "runtime_options.h"
 
@@ -72,22 +79,86 @@
  #endif
 #endif
 
-#define DUMP_IMG(basename)
+#define DUMP_IMG(blob, basename, id)
 #ifdef ENABLE_OP_TRACE
 //#define ENABLE_IMG_DUMP_TO_DISK    // dump images to desktop
 
  #ifdef ENABLE_IMG_DUMP_TO_DISK
   #undef DUMP_IMG
-  #define DUMP_IMG(basename) util::debug::save_blob_to_disk(blob, basename "-a", ref_num);
+  #define DUMP_IMG(blob, basename, id) util::debug::save_blob_to_disk(blob, basename "-a", id);
  #endif
 #endif
 
 
 namespace pdftoedn
 {
+    // pages are displayed at 72 DPI so the CTM is in points
+    static const double POINTS_PER_INCH = 72.0;
+
+    // bump when anything that changes how images are encoded is
+    // added so older --image_cache entries aren't used
+    static const char* IMAGE_FINGERPRINT_VERSION = "pdftoedn-img-2";
+
+    //
+    // orthogonal rotations and flips are applied to the pixel rows;
+    // only arbitrary rotations need leptonica
+    static bool needs_xform_lib(const PdfTM& ctm)
+    {
+        int rotation;
+        bool flip_h, flip_v;
+        return (ctm.is_transformed() &&
+                !util::xform::orthogonal_orientation(ctm, rotation, flip_h, flip_v));
+    }
+
+    //
+    // images are encoded in the requested format unless they need
+    // transforming by leptonica, which writes PNGs
+    static ImageCodec decoded_image_codec(const PdfTM& ctm)
+    {
+        return (needs_xform_lib(ctm) ? ImageCodec(ImageCodec::PNG) : options.image_codec());
+    }
+
+    //
+    // the size the image's axes are displayed at determines its
+    // resolution. Returns false if it doesn't need downsampling to
+    // fit --max_image_dpi
+    static bool scaled_image_size(const PdfTM& ctm, uint32_t width, uint32_t height,
+                                  uint32_t& scaled_width, uint32_t& scaled_height)
+    {
+        uintmax_t max_dpi = pdftoedn::options.max_image_dpi();
+        if (max_dpi == 0) {
+            return false;
+        }
+
+        double max_width = std::ceil(std::hypot(ctm.a(), ctm.b()) / POINTS_PER_INCH * max_dpi);
+        double max_height = std::ceil(std::hypot(ctm.c(), ctm.d()) / POINTS_PER_INCH * max_dpi);
+
+        if (max_width >= width && max_height >= height) {
+            return false;
+        }
+
+        scaled_width = static_cast<uint32_t>(std::max(1.0, std::min<double>(max_width, width)));
+        scaled_height = static_cast<uint32_t>(std::max(1.0, std::min<double>(max_height, height)));
+        return true;
+    }
+
     //------------------------------------------------------------------------
     // pdftoedn::OutputDev
     //------------------------------------------------------------------------
+    OutputDev::OutputDev(Catalog* doc_cat, pdftoedn::FontEngine& fnt_engine) :
+        EngOutputDev(doc_cat),
+        font_engine(fnt_engine),
+        inline_img_id(IMG_RES_ID_UNDEF - 1),
+        replaying(false),
+        image_workers(pdftoedn::options.image_workers())
+    { }
+
+    OutputDev::~OutputDev()
+    {
+        // jobs can still be queued if processing stopped mid-page
+        image_workers.wait();
+        util::delete_ptr_container_elems(pending_images);
+    }
 
     //
     // begin page processing
@@ -141,6 +212,9 @@ namespace pdftoedn
     {
         DBG_TRACE(std::cerr << __FUNCTION__ << std::endl);
 
+        // images must be done before the page is output
+        finish_pending_images();
+
         // close page collection
         pg_data->finalize();
     }
@@ -443,7 +517,7 @@ namespace pdftoedn
     {
         DBG_TRACE_IMG(std::cerr << "===========================" << std::endl << __FUNCTION__);
 
-        if (pdftoedn::options.text_output_only() ||
+        if (skip_graphics() ||
             state->getFillColorSpace()->isNonMarking()) {
             return;
         }
@@ -498,20 +572,18 @@ namespace pdftoedn
                                      << "\tctm: " << std::endl << ctm
                                      << std::endl; );
 
-            // extract the data and copy it to a string stream
-            std::ostringstream blob;
-            bool encode_status = util::encode::encode_mask(blob, imgStr, properties);
+            // extract the data - it is encoded separately
+            util::encode::PixelData pixels;
+            bool read_status = util::encode::read_mask(pixels, imgStr, properties);
 
             // poppler cleanup
             delete imgStr;
 
-            // don't continue if encode failed
-            if (!encode_status ||
-                !process_image_blob(blob, ctm, bbox, properties, width, height, ref_num)) {
+            // don't continue if reading failed
+            if (!read_status ||
+                !process_image(pixels, ctm, bbox, properties, ref_num)) {
                 return;
             }
-
-            DUMP_IMG("img_mask");
         }
         DBG_TRACE_IMG(
         else {
@@ -535,7 +607,7 @@ namespace pdftoedn
                                         GfxImageColorMap *maskColorMap,
                                         bool maskInterpolate)
     {
-        if (pdftoedn::options.text_output_only() ||
+        if (skip_graphics() ||
             state->getFillColorSpace()->isNonMarking()) {
             return;
         }
@@ -584,24 +656,21 @@ namespace pdftoedn
                                                       maskColorMap->getNumPixelComps(),
                                                       maskColorMap->getBits());
 
-            // image data will be written here
-            std::ostringstream blob;
-            bool encode_status = util::encode::encode_rgba_image(blob, imgStr, maskImgStr,
-                                                                 properties,
-                                                                 colorMap, maskColorMap,
-                                                                 false);
+            // image data will be read here
+            util::encode::PixelData pixels;
+            bool read_status = util::encode::read_rgba_image(pixels, imgStr, maskImgStr,
+                                                             properties,
+                                                             colorMap, maskColorMap,
+                                                             false);
             // poppler cleanup
             delete maskImgStr;
             delete imgStr;
 
-            // don't continue if encode failed
-            if (!encode_status ||
-                !process_image_blob(blob, ctm, bbox, properties, width, height,
-                                    ref_num)) {
+            // don't continue if reading failed
+            if (!read_status ||
+                !process_image(pixels, ctm, bbox, properties, ref_num)) {
                 return;
             }
-
-            DUMP_IMG("softmasked_img");
         }
 
         // add a meta container for the image
@@ -636,7 +705,7 @@ namespace pdftoedn
     {
         DBG_TRACE_IMG(std::cerr << " + ---- " << __FUNCTION__ << " ---- + " << std::endl);
 
-        if (pdftoedn::options.text_output_only() ||
+        if (skip_graphics() ||
             state->getFillColorSpace()->isNonMarking()) {
             return;
         }
@@ -680,25 +749,22 @@ namespace pdftoedn
                                                   colorMap->getBits());
             ImageStream *maskImgStr = new ImageStream(maskStr, maskWidth, 1, 1);
 
-            // image data will be written here
-            std::ostringstream blob;
-            bool encode_status = util::encode::encode_rgba_image(blob, imgStr, maskImgStr,
-                                                                 properties,
-                                                                 colorMap, nullptr,
-                                                                 maskInvert);
+            // image data will be read here
+            util::encode::PixelData pixels;
+            bool read_status = util::encode::read_rgba_image(pixels, imgStr, maskImgStr,
+                                                             properties,
+                                                             colorMap, nullptr,
+                                                             maskInvert);
 
             // poppler cleanup
             delete maskImgStr;
             delete imgStr;
 
-            // don't continue if encode failed
-            if (!encode_status ||
-                !process_image_blob(blob, ctm, bbox, properties, width, height,
-                                    ref_num)) {
+            // don't continue if reading failed
+            if (!read_status ||
+                !process_image(pixels, ctm, bbox, properties, ref_num)) {
                 return;
             }
-
-            DUMP_IMG("masked_img");
         }
 
         // add a meta container for the image
@@ -712,7 +778,7 @@ namespace pdftoedn
                               int width, int height, GfxImageColorMap *colorMap,
                               bool interpolate, int *maskColors, bool inlined)
     {
-        if (pdftoedn::options.text_output_only() ||
+        if (skip_graphics() ||
             state->getFillColorSpace()->isNonMarking()) {
             return;
         }
@@ -763,23 +829,43 @@ namespace pdftoedn
                                     << " ctm: " << std::endl << ctm
                                     << std::endl);
 
+            // JPEG & JPX streams may be written without decoding them
+            ImageCodec codec;
+            ImageOrientation orientation;
+            if (can_pass_through(str, colorMap, maskColors, ctm, codec, orientation)) {
+                if (process_encoded_image(str, ctm, bbox, properties, codec, orientation, ref_num)) {
+                    pg_data->new_image(ref_num, bbox);
+                }
+                return;
+            }
+
+            // images seen before, in this run or others, are taken
+            // from the cache instead of being decoded
+            std::string fingerprint;
+            if (!inlined && !pdftoedn::options.image_cache_dir().empty()) {
+                fingerprint = image_fingerprint(str, width, height, colorMap, interpolate,
+                                                maskColors, ctm);
+                if (!fingerprint.empty() &&
+                    process_cached_image(fingerprint, ctm, bbox, properties, ref_num)) {
+                    pg_data->new_image(ref_num, bbox);
+                    return;
+                }
+            }
+
             // poppler's interface to rip through a stream for an image
             ImageStream *imgStr = new ImageStream(str, width, num_pix_comps, bpp);
 
-            // image data will be written here
-            std::ostringstream blob;
-            bool encode_status = util::encode::encode_image(blob, imgStr, properties, colorMap);
+            // image data will be read here
+            util::encode::PixelData pixels;
+            bool read_status = util::encode::read_image(pixels, imgStr, properties, colorMap);
 
             // poppler cleanup
             delete imgStr;
 
-            if (!encode_status ||
-                !process_image_blob(blob, ctm, bbox, properties, width, height,
-                                    ref_num)) {
+            if (!read_status ||
+                !process_image(pixels, ctm, bbox, properties, ref_num, fingerprint)) {
                 return;
             }
-
-            DUMP_IMG("img");
         }
 
         // add a meta container for the image
@@ -787,53 +873,455 @@ namespace pdftoedn
     }
 
 
+    // ========================================================
+    // image data read from poppler. It is encoded, transformed,
+    // hashed and written to disk on a worker thread
+    //
+    struct OutputDev::ImageJob {
+        // how the image data is produced
+        enum Source {
+            ENCODED,        // decoded by poppler and encoded
+            PASSED_THROUGH, // JPEG or JPX data copied as it is
+            FROM_CACHE,     // linked from --image_cache
+        };
+
+        ImageJob(intmax_t id, const PdfTM& m, const StreamProps& props) :
+            source(ENCODED), res_id(id), ctm(m), properties(props), codec(decoded_image_codec(m)),
+            first_inline_id(0), scaled_width(0), scaled_height(0),
+            width(0), height(0), data_length(0), status(false)
+        { }
+        // encoded data passed through as it is
+        ImageJob(intmax_t id, const PdfTM& m, const StreamProps& props,
+                 const ImageCodec& c, const ImageOrientation& o) :
+            source(PASSED_THROUGH), res_id(id), ctm(m), properties(props), codec(c), orientation(o),
+            first_inline_id(0), scaled_width(0), scaled_height(0),
+            width(0), height(0), data_length(0), status(false)
+        { }
+
+        bool encode();
+        void run();
+        // counts encoded images and their size once they're written
+        void count_encoded() const;
+
+        Source source;
+        intmax_t res_id;
+        PdfTM ctm;
+        StreamProps properties;
+        ImageCodec codec;
+        ImageOrientation orientation;
+        // id the next inlined image gets - ones cached while this
+        // is pending may be duplicates of it
+        intmax_t first_inline_id;
+        util::encode::PixelData pixels;
+        // size to downsample to if set (--max_image_dpi)
+        uint32_t scaled_width, scaled_height;
+        std::string file_path;
+        // temporary file large images are encoded to
+        std::string spool_file;
+        // --image_cache: the key to store the result under or, if it
+        // was found, the file to link
+        std::string fingerprint;
+        std::string cached_file;
+
+        // results
+        std::string data;
+        int width, height;
+        std::string data_md5;
+        uintmax_t data_length;
+        bool status;
+    };
+
     //
-    // transform the encoded image if needed, then cache it
-    bool OutputDev::process_image_blob(const std::ostringstream& blob, const PdfTM& ctm,
-                                       const BoundingBox& bbox, const StreamProps& properties,
-                                       int width, int height,
-                                       intmax_t& ref_num)
+    // encode the pixels and transform the image if needed. Width
+    // and height are updated as they may be modified by the
+    // transformation
+    bool OutputDev::ImageJob::encode()
     {
-        std::string data = blob.str();
+        // passed through data only needs to be hashed
+        if (codec.is_passthrough()) {
+            data_md5 = util::md5(data);
+            return true;
+        }
+
+        if (scaled_width > 0 && scaled_height > 0) {
+            util::encode::downsample(pixels, scaled_width, scaled_height);
+        }
+
+        // rotate or flip the rows if it's orthogonal
+        int rotation;
+        bool flip_h, flip_v;
+        bool transform = ctm.is_transformed();
+        if (transform && util::xform::orthogonal_orientation(ctm, rotation, flip_h, flip_v)) {
+            StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_XFORM);
+            util::encode::orient(pixels, rotation, flip_h, flip_v);
+            transform = false;
+        }
+
+        // images to be transformed by leptonica are decoded again
+        // right away so only spend the minimum on compressing
+        // them. Their data is replaced so it's hashed after the
+        // transformation; otherwise, the md5 is computed as the data
+        // is encoded
+        util::encode::ImageBuffer blob(!transform);
+
+        // images whose rows exceeded --image_memory_limit are
+        // encoded to a temporary file next to their destination
+        // unless leptonica needs the data
+        if (pixels.rows.is_mapped() && !transform && !properties.is_inlined() &&
+            !pdftoedn::options.edn_output_only()) {
+            boost::filesystem::path tmp_path(file_path);
+            tmp_path += boost::filesystem::unique_path(".%%%%-%%%%.tmp");
+            spool_file = tmp_path.string();
+
+            if (!blob.open_file(spool_file)) {
+                std::stringstream err;
+                err << "Error opening '" << spool_file << "' to encode image";
+                et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE, err.str());
+                spool_file.clear();
+                return false;
+            }
+        }
+
+        bool encode_status = util::encode::encode(blob, pixels,
+                                                  (transform ? ImageCodec(ImageCodec::PNG_FAST) : codec));
+
+        width = pixels.width;
+        height = pixels.height;
+
+        // the rows are no longer needed
+        pixels = util::encode::PixelData();
+
+        if (!spool_file.empty()) {
+            encode_status = (blob.close_file() && encode_status);
+            data_length = blob.size();
+        }
+
+        if (!encode_status) {
+            return false;
+        }
+
+        DUMP_IMG(blob.data(), "img", res_id);
+
+        data.swap(blob.data());
 
         // handle transformations if needed
-        if (ctm.is_transformed()) {
+        if (transform) {
             if (util::xform::transform_image(ctm, data, width, height,
                                              properties.mask_is_inverted()) == util::xform::XFORM_ERR) {
                 // don't continue if transform failed
                 return false;
             }
+            data_md5 = util::md5(data);
+        } else {
+            data_md5 = blob.md5();
         }
+        return true;
+    }
+
+    //
+    // worker task - encode and write the image
+    void OutputDev::ImageJob::run()
+    {
+        try
+        {
+            // images found in the cache are linked from there
+            bool from_cache = (source == FROM_CACHE);
+            status = (from_cache || encode());
+
+            // identical images, in this document or others written to
+            // the same directory, share a file named by their md5
+            if (status && pdftoedn::options.dedup_images() &&
+                !pdftoedn::options.get_image_path(data_md5, codec, file_path)) {
+                et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE,
+                              "failed to determine absolute file path to write image data to disk");
+                status = false;
+            }
+
+            if (status) {
+                bool write_status;
+                if (from_cache) {
+                    write_status = (pdftoedn::options.edn_output_only() ||
+                                    util::fs::link_file(cached_file, file_path));
+                } else if (!spool_file.empty()) {
+                    write_status = util::fs::move_image_to_disk(spool_file, file_path);
+                    spool_file.clear();
+                } else {
+                    write_status = util::fs::write_image_to_disk(file_path, data);
+                }
+
+                if (!write_status) {
+                    std::stringstream err;
+                    err << "Error writing '" << file_path << "' to disk";
+                    et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE, err.str());
+                    status = false;
+                }
+            }
 
-        std::string data_md5 = util::md5(data);
+            if (status && !from_cache && !fingerprint.empty() &&
+                !pdftoedn::options.edn_output_only()) {
+                util::image_cache::store(fingerprint, codec, file_path, data_md5, width, height);
+            }
+        }
+        catch (std::exception& e) {
+            // not much else to do on a worker thread
+            et.log_error( ErrorTracker::ERROR_PAGE_DATA, MODULE, e.what() );
+            status = false;
+        }
+
+        // remove the temporary file of an image that failed
+        if (!spool_file.empty()) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(spool_file, ec);
+        }
 
-        // we've seen instances of repeated usage of inlined streams
-        // so we cache them and search the cache by md5
-        if (properties.is_inlined()) {
-            // If inlined, PdfPage will search to make sure an image
-            // w/ same md5 is not already in the DB and return its
-            // ref_num instead of caching it again.  Otherwise, the
-            // same ref_num is returned
+        // large images were written straight to disk
+        if (data_length == 0) {
+            data_length = data.length();
+        }
+        std::string().swap(data);
+    }
+
+    //
+    // passed-through and cached images are counted when queued
+    void OutputDev::ImageJob::count_encoded() const
+    {
+        if (source == ENCODED) {
+            stats.count(StatsTracker::COUNT_IMAGES_ENCODED);
+            stats.count(StatsTracker::COUNT_IMAGE_BYTES, data_length);
+        }
+    }
+
+
+    //
+    // hand the image data off to be encoded and cached. Inlined
+    // images are looked up by the md5 of the encoded data to
+    // determine their resource id so they are encoded here; others
+    // are reserved in the page's cache and queued for the workers
+    bool OutputDev::process_image(util::encode::PixelData& pixels, const PdfTM& ctm,
+                                  const BoundingBox& bbox, const StreamProps& properties,
+                                  intmax_t& ref_num, const std::string& fingerprint)
+    {
+        ImageJob* job = new ImageJob(ref_num, ctm, properties);
+        job->fingerprint = fingerprint;
+
+        scaled_image_size(ctm, pixels.width, pixels.height,
+                          job->scaled_width, job->scaled_height);
+
+        std::swap(job->pixels, pixels);
+        return queue_image(job, bbox, ref_num);
+    }
+
+    //
+    // JPEG or JPX data copied from the stream
+    bool OutputDev::process_encoded_image(Stream* str, const PdfTM& ctm,
+                                          const BoundingBox& bbox, const StreamProps& properties,
+                                          const ImageCodec& codec, const ImageOrientation& orientation,
+                                          intmax_t& ref_num)
+    {
+        ImageJob* job = new ImageJob(ref_num, ctm, properties, codec, orientation);
+        job->width = properties.bitmap_width();
+        job->height = properties.bitmap_height();
+
+        if (!util::encode::read_encoded_stream(job->data, str)) {
+            delete job;
+            return false;
+        }
+
+        stats.count(StatsTracker::COUNT_IMAGES_PASSED_THROUGH);
+        return queue_image(job, bbox, ref_num);
+    }
+
+    //
+    // fingerprint of the image's undecoded data and everything that
+    // affects how it's decoded and encoded for --image_cache. Empty
+    // if it can't be cached
+    std::string OutputDev::image_fingerprint(Stream* str, int width, int height,
+                                             GfxImageColorMap* colorMap, bool interpolate,
+                                             int* maskColors, const PdfTM& ctm) const
+    {
+        // leptonica's arbitrary rotations aren't worth keying on
+        int rotation = 0;
+        bool flip_h = false, flip_v = false;
+        if (ctm.is_transformed() &&
+            !util::xform::orthogonal_orientation(ctm, rotation, flip_h, flip_v)) {
+            return "";
+        }
+
+        uint32_t scaled_width = width, scaled_height = height;
+        scaled_image_size(ctm, width, height, scaled_width, scaled_height);
+
+        std::stringstream params;
+        params << IMAGE_FINGERPRINT_VERSION << " "
+               << str->getKind() << " " << width << "x" << height << " "
+               << interpolate << " " << ctm.is_upside_down() << " "
+               << decoded_image_codec(ctm).name() << " "
+               << scaled_width << "x" << scaled_height << " "
+               << ctm.is_transformed() << " " << rotation << " " << flip_h << " " << flip_v;
+        if (maskColors) {
+            for (int i = 0; i < 2 * colorMap->getNumPixelComps(); i++) {
+                params << " " << maskColors[i];
+            }
+        }
+
+        util::MD5Hash hash;
+        std::string p = params.str();
+        hash.update(p.data(), p.length());
+
+        if (!util::encode::hash_raw_stream(hash, str)) {
+            return "";
+        }
+        util::encode::hash_color_map(hash, colorMap);
+        return hash.hexdigest();
+    }
+
+    //
+    // image found in the cache - the job links the cached file
+    // instead of encoding it
+    bool OutputDev::process_cached_image(const std::string& fingerprint, const PdfTM& ctm,
+                                         const BoundingBox& bbox, const StreamProps& properties,
+                                         intmax_t& ref_num)
+    {
+        util::image_cache::Entry entry;
+        if (!util::image_cache::lookup(fingerprint, decoded_image_codec(ctm), entry)) {
+            return false;
+        }
+
+        ImageJob* job = new ImageJob(ref_num, ctm, properties);
+        job->source = ImageJob::FROM_CACHE;
+        job->cached_file = entry.file_path;
+        job->data_md5 = entry.md5;
+        job->width = entry.width;
+        job->height = entry.height;
+
+        stats.count(StatsTracker::COUNT_IMAGES_FROM_CACHE);
+        return queue_image(job, bbox, ref_num);
+    }
+
+    //
+    // takes ownership of the job
+    bool OutputDev::queue_image(ImageJob* job, const BoundingBox& bbox, intmax_t& ref_num)
+    {
+        const StreamProps& properties = job->properties;
+
+        if (!properties.is_inlined()) {
+            if (!pg_data->reserve_image(ref_num, bbox, job->codec, job->orientation,
+                                        properties, job->file_path)) {
+                delete job;
+                return false;
+            }
+
+            job->first_inline_id = inline_img_id;
+            pending_images.push_back(job);
+            image_workers.run( [job]() { job->run(); } );
+            return true;
+        }
+
+        bool status = job->encode();
+        if (status) {
+            // we've seen instances of repeated usage of inlined
+            // streams so we cache them and search the cache by md5.
+            // PdfPage will search to make sure an image w/ same md5
+            // is not already in the DB and return its ref_num instead
+            // of caching it again
+            //
+            // images queued on the workers don't have an md5 until
+            // they're done so they can't be found here. Duplicates of
+            // those are merged when the workers finish
             intmax_t cached_res_id;
-            if (pg_data->inlined_image_is_cached(data_md5, cached_res_id)) {
+            if (pg_data->inlined_image_is_cached(job->data_md5, cached_res_id)) {
                 // return the resource id found
                 ref_num = cached_res_id;
-                return true;
             }
+            else {
+                // decrement the custom assigned inline_img_id for
+                // the next instance
+                inline_img_id -= 1;
+
+                // cache it - cache_image()
+                status = pg_data->cache_image(ref_num, bbox, job->width, job->height,
+                                              job->codec, job->orientation,
+                                              properties, job->data, job->data_md5);
+                if (status) {
+                    job->data_length = job->data.length();
+                    job->count_encoded();
+                }
+            }
+        }
+
+        delete job;
+        return status;
+    }
 
-            // decrement the custom assigned inline_img_id for
-            // the next instance
-            inline_img_id -= 1;
+
+    //
+    // JPEG and JPX streams that poppler would only decode for them to
+    // be encoded again are written as they are if their samples don't
+    // need converting. Orthogonal transformations are left to the
+    // consumer
+    bool OutputDev::can_pass_through(Stream* str, GfxImageColorMap* colorMap, int* maskColors,
+                                     const PdfTM& ctm, ImageCodec& codec,
+                                     ImageOrientation& orientation) const
+    {
+        if (!pdftoedn::options.image_passthrough() || maskColors) {
+            return false;
         }
 
-        // cache it - cache_image()
-        if (!pg_data->cache_image(ref_num, bbox, width, height, properties,
-                                  data, data_md5)) {
-            // error caching image
+        switch (str->getKind())
+        {
+          case strDCT:
+              codec = ImageCodec(ImageCodec::JPEG);
+              break;
+          case strJPX:
+              codec = ImageCodec(ImageCodec::JPX);
+              break;
+          default:
+              return false;
+        }
+
+        // 8-bit gray or RGB with the default decode array
+        int num_pix_comps = colorMap->getNumPixelComps();
+        GfxColorSpaceMode cspace_mode = colorMap->getColorSpace()->getMode();
+
+        if (colorMap->getBits() != 8 ||
+            (num_pix_comps != 1 && num_pix_comps != 3) ||
+            (cspace_mode != csDeviceGray && cspace_mode != csDeviceRGB && cspace_mode != csICCBased)) {
             return false;
         }
 
-        return true;
+        for (int i = 0; i < num_pix_comps; i++) {
+            if (colorMap->getDecodeLow(i) != 0 || colorMap->getDecodeHigh(i) != 1) {
+                return false;
+            }
+        }
+
+        orientation = ImageOrientation();
+        if (!ctm.is_transformed()) {
+            return true;
+        }
+        return util::xform::orthogonal_orientation(ctm, orientation.rotation,
+                                                   orientation.flip_h, orientation.flip_v);
+    }
+
+
+    //
+    // wait for the workers to finish the page's images and update
+    // the cache with the results. Images that failed are dropped
+    void OutputDev::finish_pending_images()
+    {
+        image_workers.wait();
+
+        for (ImageJob* job : pending_images) {
+            if (job->status) {
+                pg_data->image_encoded(job->res_id, job->width, job->height,
+                                       job->data_md5, job->file_path);
+                pg_data->merge_inlined_images(job->res_id, job->data_md5, job->first_inline_id);
+                job->count_encoded();
+            } else {
+                pg_data->drop_image(job->res_id);
+            }
+            delete job;
+        }
+        pending_images.clear();
     }
 
 
@@ -1112,7 +1600,7 @@ namespace pdftoedn
 
     void OutputDev::build_path_command(GfxState* state, PdfDocPath::Type type, PdfDocPath::EvenOddRule eo_flag)
     {
-        if (pdftoedn::options.text_output_only() ||
+        if (skip_graphics() ||
             !state->getPath()) {
             return;
         }
@@ -23,16 +23,26 @@
 #endif
 
 #include <queue>
+#include <list>
 
 #include <poppler/GfxState.h>
 
 #include "eng_output_dev.h"
 #include "graphics.h"
+#include "runtime_options.h"
+#include "util_workers.h"
 
 namespace pdftoedn
 {
     class FontEngine;
     class StreamProps;
+    struct ImageOrientation;
+
+    namespace util {
+        namespace encode {
+            struct PixelData;
+        }
+    }
 
     //------------------------------------------------------------------------
     // pdftoedn::OutputDev
@@ -44,16 +54,16 @@ namespace pdftoedn
 
         // constructor takes reference to object that will store
         // extracted data
-        OutputDev(Catalog* doc_cat, pdftoedn::FontEngine& fnt_engine) :
-            EngOutputDev(doc_cat),
-            font_engine(fnt_engine),
-            inline_img_id(IMG_RES_ID_UNDEF - 1)
-        { }
-        virtual ~OutputDev() { }
+        OutputDev(Catalog* doc_cat, pdftoedn::FontEngine& fnt_engine);
+        virtual ~OutputDev();
 
         // set up font manager, etc.
         bool init();
 
+        virtual void set_replay_mode(bool replay) override { replaying = replay; }
+        virtual int next_inline_image_id() const override { return inline_img_id; }
+        virtual void set_next_inline_image_id(int id) override { inline_img_id = id; }
+
         // POPPLER virtual interface
         // =========================
         // Does this device use drawChar() or drawString()?
@@ -172,16 +182,41 @@ namespace pdftoedn
         virtual void clearSoftMask(GfxState * /*state*/) override;
 
     private:
+        struct ImageJob;
+
         pdftoedn::FontEngine& font_engine;
         PdfTM text_tm;
         std::queue<Unicode> actual_text;
         int inline_img_id;
+        bool replaying;
+
+        // images are encoded by the workers while the page is read
+        util::WorkerPool image_workers;
+        std::list<ImageJob*> pending_images;
+
+        // images and paths are skipped if only extracting text or
+        // if replaying a page
+        bool skip_graphics() const { return (replaying || pdftoedn::options.text_output_only()); }
 
         // non-virtual methods; helpers
-        bool process_image_blob(const std::ostringstream& blob, const PdfTM& ctm,
-                                const BoundingBox& bbox, const StreamProps& properties,
-                                int width, int height,
-                                intmax_t& ref_num);
+        bool process_image(util::encode::PixelData& pixels, const PdfTM& ctm,
+                           const BoundingBox& bbox, const StreamProps& properties,
+                           intmax_t& ref_num, const std::string& fingerprint = "");
+        std::string image_fingerprint(Stream* str, int width, int height,
+                                      GfxImageColorMap* colorMap, bool interpolate,
+                                      int* maskColors, const PdfTM& ctm) const;
+        bool process_cached_image(const std::string& fingerprint, const PdfTM& ctm,
+                                  const BoundingBox& bbox, const StreamProps& properties,
+                                  intmax_t& ref_num);
+        bool process_encoded_image(Stream* str, const PdfTM& ctm,
+                                   const BoundingBox& bbox, const StreamProps& properties,
+                                   const ImageCodec& codec, const ImageOrientation& orientation,
+                                   intmax_t& ref_num);
+        bool queue_image(ImageJob* job, const BoundingBox& bbox, intmax_t& ref_num);
+        bool can_pass_through(Stream* str, GfxImageColorMap* colorMap, int* maskColors,
+                              const PdfTM& ctm, ImageCodec& codec,
+                              ImageOrientation& orientation) const;
+        void finish_pending_images();
         void build_path_command(GfxState* state, PdfDocPath::Type type,
                                 PdfDocPath::EvenOddRule eo_rule = PdfDocPath::EVEN_ODD_RULE_DISABLED);
     };
@@ -17,8 +17,17 @@
 // along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <list>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <cstdio>
+#include <memory>
+#include <boost/filesystem.hpp>
 
 #include <poppler/goo/GooList.h>
+#include <poppler/goo/gfile.h>
+#include <poppler/Stream.h>
 #include <poppler/Outline.h>
 #include <poppler/Link.h>
 #include <poppler/ErrorCodes.h>
@@ -26,6 +35,7 @@
 #include "util.h"
 #include "util_debug.h"
 #include "util_edn.h"
+#include "util_fs.h"
 #include "util_versions.h"
 #include "pdf_reader.h"
 #include "pdf_output_dev.h"
@@ -34,6 +44,7 @@
 #include "pdf_doc_outline.h"
 #include "doc_page.h"
 #include "runtime_options.h"
+#include "pdf_stats_tracker.h"
 
 namespace pdftoedn
 {
@@ -52,6 +63,16 @@ namespace pdftoedn
 
     static const pdftoedn::Symbol SYMBOL_VERSIONS           = "versions";
 
+    static const pdftoedn::Symbol SYMBOL_META               = "meta";
+    static const pdftoedn::Symbol SYMBOL_PAGES              = "pages";
+    static const pdftoedn::Symbol SYMBOL_PAGE_FILES         = "page_files";
+
+    static const std::string SHARD_META_FILENAME            = "meta";
+    static const std::string SHARD_PAGE_FILENAME_PREFIX     = "page-";
+    static const std::string SHARD_FILE_EXT                 = ".edn";
+    static const std::string SHARD_TMP_FILE_EXT             = ".tmp";
+    static const std::string SHARD_JOURNAL_FILENAME         = "pages.journal";
+
     const double PDFReader::DPI_72 = 72.0;
 
     // helper function that returns a GooString for the password if
@@ -65,12 +86,105 @@ namespace pdftoedn
         return new GooString(passwd.c_str());
     }
 
+    // ----------------------------------------------------------------
+    // input streams handed to poppler. PDFDoc deletes the stream it
+    // is given so each one owns the resource backing it
+    //
+
+    //
+    // FileStream over a file we opened - same as what PDFDoc sets up
+    // when given a file name but the stream must release the file
+    class OwnedFileStream : public FileStream
+    {
+    public:
+        OwnedFileStream(GooFile* f) :
+            FileStream(f, 0, false, f->size(), Object(objNull)),
+            file(f)
+        { }
+        virtual ~OwnedFileStream() {
+            close();
+            delete file;
+        }
+
+    private:
+        GooFile* file;
+    };
+
+    //
+    // MemStream over a read-only mapping of the input file
+    class MappedFileStream : public MemStream
+    {
+    public:
+        MappedFileStream(char* data, uintmax_t len) :
+            MemStream(data, 0, len, Object(objNull)),
+            mapped_data(data), mapped_len(len)
+        { }
+        virtual ~MappedFileStream() {
+            util::fs::unmap_file(mapped_data, mapped_len);
+        }
+
+    private:
+        char* mapped_data;
+        uintmax_t mapped_len;
+    };
+
+    //
+    // MemStream over a buffer holding the full document read from
+    // stdin
+    class StdinStream : public MemStream
+    {
+    public:
+        StdinStream(std::string* d) :
+            MemStream(&(*d)[0], 0, d->size(), Object(objNull)),
+            data(d)
+        { }
+        virtual ~StdinStream() {
+            delete data;
+        }
+
+    private:
+        std::string* data;
+    };
+
+    //
+    // opens the input document. If requested, the file is mapped
+    // into memory but, if that fails, it is read as usual
+    static BaseStream* open_input_stream(const std::string& filename)
+    {
+        if (pdftoedn::options.pdf_from_stdin()) {
+            std::string* data = new std::string;
+            if (!util::fs::read_stream(std::cin, *data) || data->empty()) {
+                delete data;
+                throw invalid_file("Document open error: couldn't read the PDF from stdin");
+            }
+            return new StdinStream(data);
+        }
+
+        if (pdftoedn::options.mmap_input()) {
+            char* data;
+            uintmax_t len;
+            if (util::fs::map_file(filename, &data, len)) {
+                return new MappedFileStream(data, len);
+            }
+        }
+
+        GooString gfilename(filename.c_str());
+        GooFile* file = GooFile::open(&gfilename);
+        if (!file) {
+            std::stringstream err;
+            err << "Document open error: "
+                << util::debug::get_poppler_doc_error_str(errOpenFile);
+            throw invalid_file(err.str());
+        }
+        return new OwnedFileStream(file);
+    }
+
     //
     // opens the document and preps things for processing. throws if
     // font engine fails to init freetype (from FE constructor) or if
     // poppler fails to open the file
     PDFReader::PDFReader() :
-        PDFDoc(new GooString(pdftoedn::options.pdf_filename().c_str()),
+        PDFDoc(open_input_stream(pdftoedn::options.pdf_filename()),
                get_pdf_password(pdftoedn::options.pdf_owner_password()),
                get_pdf_password(pdftoedn::options.pdf_user_password())),
         font_engine(getXRef()),
@@ -100,6 +214,35 @@ namespace pdftoedn
             throw init_error(err.str());
         }
 
+        // same for page ranges
+        uintmax_t invalid_pg = pdftoedn::options.page_ranges().first_invalid_page(getNumPages());
+        if (invalid_pg != PageRanges::OPEN_END) {
+            std::stringstream err;
+            err << "Error: requested page number " << invalid_pg
+                << " in page list '" << pdftoedn::options.page_ranges()
+                << "' is not valid (document has "
+                << getNumPages() << " page";
+            if (getNumPages() > 1) {
+                err << "s";
+            }
+            err << " and values must be 0-indexed)";
+            throw init_error(err.str());
+        }
+
+        // determine the pages to extract. Pages are loaded by poppler
+        // as they are displayed so the ones not listed are never
+        // parsed
+        if (pdftoedn::options.page_number() >= 0) {
+            page_list.push_back(pdftoedn::options.page_number());
+        } else if (!pdftoedn::options.page_ranges().empty()) {
+            page_list = pdftoedn::options.page_ranges().page_list(getNumPages());
+        } else {
+            page_list.reserve(getNumPages());
+            for (int ii = 0; ii < getNumPages(); ++ii) {
+                page_list.push_back(ii);
+            }
+        }
+
         // TESLA-6245: Mike P requested a way to extract only links
         // from a doc. To do this, we use a different type of
         // OutputDev that ignores everything but links
@@ -141,22 +284,11 @@ namespace pdftoedn
 
         // pre-process doc for font data
         FontEngDev fe_dev(font_engine);
-        uint32_t num_pages = getNumPages();
-
-        uintmax_t first, last;
 
-        if (pdftoedn::options.page_number() != -1) {
-            first = pdftoedn::options.page_number();
-            last = first + 1;
-        } else {
-            first = 1;
-            last = num_pages;
-        }
-
-        for (uintmax_t page = first; page <= last; page++)
+        for (uintmax_t page : page_list)
         {
-            // process the PDF info on this page
-            process_page(&fe_dev, page);
+            // process the PDF info on this page (poppler is 1-based)
+            process_page(&fe_dev, page + 1);
         }
 
 #if 0
@@ -240,6 +372,7 @@ namespace pdftoedn
         // generated by the page
         et.flush_errors();
 
+        StatsTracker::Timer t(StatsTracker::PHASE_INTERPRET);
         displayPage(dev, page_num, DPI_72, DPI_72, 0, false, true, false);
     }
 
@@ -255,14 +388,26 @@ namespace pdftoedn
 
         if (page_num <= num_pages) {
 
+            // stats are reported using the 0-based page number
+            stats.begin_page(page_num - 1);
+
             // process the PDF info on this page
             process_page(eng_odev, page_num);
 
             const PdfPage* page = eng_odev->page_data();
 
             if (page) {
+                StatsTracker::Timer t(StatsTracker::PHASE_EDN_OUTPUT);
+                std::streampos start_pos = (stats.is_enabled() ? o.tellp() : std::streampos(-1));
+
                 o << *page;
+
+                if (start_pos != std::streampos(-1)) {
+                    stats.count(StatsTracker::COUNT_EDN_BYTES, o.tellp() - start_pos);
+                }
             }
+
+            stats.end_page();
         }
 
         return o;
@@ -272,33 +417,189 @@ namespace pdftoedn
     {
         // return a hash with the data in the format
         // { :meta { <meta> }, :pages [ {<page1>} {<page2>} ... {<pageN>} ] }
-        static const pdftoedn::Symbol Meta("meta");
-        static const pdftoedn::Symbol Pages("pages");
-
         // but dont store it in a hash so we write a page at a time
-        o << "{" << Meta << " ";
+        o << "{" << SYMBOL_META << " ";
         output_meta(o);
-        o << ", " << Pages << " [";
-
-        uintmax_t start_page, end_page;
+        o << ", " << SYMBOL_PAGES << " [";
 
-        if (options.page_number() < 0) {
-            start_page = 0;
-            end_page = getNumPages();
-        } else {
-            start_page = options.page_number();
-            end_page = start_page + 1;
+        for (uintmax_t page : page_list) {
+            output_page(page, o);
         }
+        o << "]";
 
-        for (uintmax_t ii = start_page; ii < end_page; ++ii) {
-            output_page(ii, o);
+        // the meta is written before any page is processed so, when
+        // requested, the collected stats follow the page list
+        if (stats.is_enabled() && options.include_debug_info()) {
+            o << ", " << StatsTracker::SYMBOL_STATS << " " << stats;
         }
 
-        o << "]}";
+        o << "}";
         return o;
     }
 
 
+    // ----------------------------------------------------------------
+    // per-page output. Writes:
+    //
+    //   <dir>/meta.edn       { :meta { <meta> }, :page_files ["page-0001.edn" ...] }
+    //   <dir>/page-0001.edn  {<page1>}
+    //   ...
+    //
+    // Page files are named using the page's 1-indexed :pgnum. As
+    // each page is completed, a line with its 0-indexed number and
+    // the next inline image id is appended to <dir>/pages.journal so
+    // the run can be resumed with --resume. Completed pages are then
+    // replayed (without images or paths) to rebuild the font list,
+    // which page font indices refer to
+    //
+    void PDFReader::write_shards(const std::string& dir, const std::string& file_ext,
+                                 const SinkFactory& open_sink)
+    {
+        namespace fs = boost::filesystem;
+
+        fs::path shard_dir(dir);
+        if (!fs::exists(shard_dir) && !fs::create_directories(shard_dir)) {
+            throw invalid_file("Cannot create page output folder " + shard_dir.string());
+        }
+
+        std::vector<std::string> page_files;
+        page_files.reserve(page_list.size());
+        for (uintmax_t page : page_list) {
+            std::stringstream name;
+            name << SHARD_PAGE_FILENAME_PREFIX << std::setw(4) << std::setfill('0') << (page + 1)
+                 << SHARD_FILE_EXT << file_ext;
+            page_files.push_back(name.str());
+        }
+
+        // the meta goes first so consumers know which pages to
+        // expect before they are written
+        write_shard((shard_dir / (SHARD_META_FILENAME + SHARD_FILE_EXT + file_ext)).string(), open_sink,
+                    [&](std::ostream& o) {
+                        o << "{" << SYMBOL_META << " ";
+                        output_meta(o);
+
+                        util::edn::Vector files_a(page_files.size());
+                        for (const std::string& f : page_files) {
+                            files_a.push(f);
+                        }
+                        o << ", " << SYMBOL_PAGE_FILES << " " << files_a << "}";
+                    });
+
+        // pages completed by a previous run
+        std::string journal_filename = (shard_dir / SHARD_JOURNAL_FILENAME).string();
+        std::map<uintmax_t, int> completed;
+        if (pdftoedn::options.resume()) {
+            uintmax_t journal_length = read_journal(journal_filename, completed);
+
+            // drop a partial entry left by a crash so the ones
+            // appended below start on their own line
+            boost::system::error_code ec;
+            if (fs::exists(journal_filename, ec) && fs::file_size(journal_filename, ec) != journal_length) {
+                fs::resize_file(journal_filename, journal_length, ec);
+                if (ec) {
+                    throw invalid_file(journal_filename + " Cannot truncate partial entry");
+                }
+            }
+
+            for (std::size_t ii = 0; ii < page_list.size(); ++ii) {
+                if (completed.count(page_list[ii]) && !fs::exists(shard_dir / page_files[ii])) {
+                    completed.erase(page_list[ii]);
+                }
+            }
+        }
+
+        // only completed pages before the last one that is still
+        // pending need replaying
+        std::size_t pages_to_process = page_list.size();
+        while (pages_to_process > 0 && completed.count(page_list[pages_to_process - 1])) {
+            --pages_to_process;
+        }
+
+        std::ofstream journal(journal_filename.c_str(),
+                              (pdftoedn::options.resume() ? std::ios::app : std::ios::trunc));
+        if (!journal.is_open()) {
+            throw invalid_file(journal_filename + " Cannot open file for write");
+        }
+
+        for (std::size_t ii = 0; ii < pages_to_process; ++ii) {
+            uintmax_t page = page_list[ii];
+
+            auto cp = completed.find(page);
+            if (cp != completed.end()) {
+                replay_page(page);
+                eng_odev->set_next_inline_image_id(cp->second);
+                continue;
+            }
+
+            write_shard((shard_dir / page_files[ii]).string(), open_sink,
+                        [&](std::ostream& o) { output_page(page, o); });
+
+            // the page file is in place - log it
+            journal << page << " " << eng_odev->next_inline_image_id() << std::endl;
+        }
+    }
+
+    //
+    // reads the pages logged in the journal. A crash can leave a
+    // partial line at the end which may still parse (e.g., "12 34"
+    // cut from "12 345") so only newline-terminated entries are
+    // used. Returns the length of those entries
+    uintmax_t PDFReader::read_journal(const std::string& filename, std::map<uintmax_t, int>& completed)
+    {
+        std::ifstream journal(filename.c_str());
+        std::string line;
+        uintmax_t length = 0;
+
+        // getline sets eof if the line wasn't terminated
+        while (std::getline(journal, line) && !journal.eof()) {
+            length += line.length() + 1;
+
+            std::istringstream entry(line);
+            uintmax_t page;
+            int inline_id;
+            if (entry >> page >> inline_id) {
+                completed[page] = inline_id;
+            }
+        }
+        return length;
+    }
+
+    //
+    // process a page that was already output by a previous run to
+    // rebuild document state. Nothing is written so nothing is
+    // counted in the stats either
+    void PDFReader::replay_page(uintmax_t page_num)
+    {
+        eng_odev->set_replay_mode(true);
+        stats.set_paused(true);
+        process_page(eng_odev, page_num + 1);
+        stats.set_paused(false);
+        eng_odev->set_replay_mode(false);
+    }
+
+    //
+    // each file is written under a temporary name and renamed when
+    // complete so readers never see a partial file
+    void PDFReader::write_shard(const std::string& filename, const SinkFactory& open_sink,
+                                const std::function<void (std::ostream&)>& output)
+    {
+        std::string tmp_filename = filename + SHARD_TMP_FILE_EXT;
+
+        std::unique_ptr<util::output::Sink> sink(open_sink(tmp_filename));
+        if (!sink) {
+            throw invalid_file(tmp_filename + " Cannot open file for write");
+        }
+
+        std::ostream o(sink.get());
+        output(o);
+
+        if (!sink->close() || std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+            std::remove(tmp_filename.c_str());
+            throw invalid_file("Error writing " + filename);
+        }
+    }
+
+
     //
     // extract the outline data
     bool PDFReader::process_outline(PdfOutline& outline_output)
@@ -25,12 +25,16 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <functional>
+#include <map>
 
 #include <poppler/PDFDoc.h>
 
 #include "font_engine.h"
 #include "pdf_doc_outline.h"
 #include "pdf_output_dev.h"
+#include "util_output.h"
 
 class LinkGoTo;
 class LinkGoToR;
@@ -46,6 +50,9 @@ namespace pdftoedn
     public:
         static const double DPI_72; // 72.0
 
+        // returns an open sink for the given file name or nullptr
+        typedef std::function<util::output::Sink* (const std::string& filename)> SinkFactory;
+
         PDFReader();
         virtual ~PDFReader() { delete eng_odev; }
 
@@ -54,6 +61,11 @@ namespace pdftoedn
 #endif
         std::ostream& process(std::ostream& o);
 
+        // writes the meta and each page to separate files in the
+        // given directory
+        void write_shards(const std::string& dir, const std::string& file_ext,
+                          const SinkFactory& open_sink);
+
         friend std::ostream& operator<<(std::ostream& o, PDFReader& doc) {
             return doc.process(o);
         }
@@ -63,6 +75,7 @@ namespace pdftoedn
         pdftoedn::EngOutputDev* eng_odev;
         pdftoedn::PdfOutline outline_output;
         bool use_page_media_box;
+        std::vector<uintmax_t> page_list; // 0-indexed pages to extract
 
         bool init_font_engine();
         bool process_outline(pdftoedn::PdfOutline& outline_output);
@@ -75,6 +88,11 @@ namespace pdftoedn
 
         void process_page(::OutputDev* dev, uintmax_t page);
 
+        void write_shard(const std::string& filename, const SinkFactory& open_sink,
+                         const std::function<void (std::ostream&)>& output);
+        uintmax_t read_journal(const std::string& filename, std::map<uintmax_t, int>& completed);
+        void replay_page(uintmax_t page_num);
+
         // returns document metadata
         std::ostream& output_meta(std::ostream& o);
         std::ostream& output_page(uintmax_t page_num, std::ostream& o);
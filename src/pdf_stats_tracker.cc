@@ -0,0 +1,179 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "pdf_stats_tracker.h"
+#include "util_edn.h"
+
+namespace pdftoedn
+{
+    const Symbol StatsTracker::SYMBOL_PHASES[]   = {
+        "interpret",
+        "font_load",
+        "image_encode",
+        "image_xform",
+        "md5",
+        "image_write",
+        "edn_output",
+    };
+
+    const Symbol StatsTracker::SYMBOL_COUNTERS[] = {
+        "chars",
+        "spans",
+        "paths",
+        "images_encoded",
+        "images_cached",
+        "images_passed_through",
+        "images_reused",
+        "images_from_cache",
+        "image_bytes",
+        "edn_bytes",
+    };
+
+    const Symbol StatsTracker::SYMBOL_STATS       = "stats";
+    const Symbol StatsTracker::SYMBOL_TOTALS      = "totals";
+    const Symbol StatsTracker::SYMBOL_PAGES       = "pages";
+    const Symbol StatsTracker::SYMBOL_PAGE_NUMBER = "pgnum";
+    const Symbol StatsTracker::SYMBOL_TIME_MS     = "time_ms";
+    const Symbol StatsTracker::SYMBOL_COUNT       = "count";
+
+    // helper to report durations in fractional milliseconds
+    static inline double to_ms(StatsTracker::clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+
+    // ========================================================
+    // per-page (or document total) record
+    //
+    StatsTracker::record::record(uintmax_t pg) :
+        page_num(pg)
+    {
+        std::fill(phases, phases + PHASE_TYPE_COUNT, clock::duration::zero());
+        std::fill(counters, counters + COUNTER_TYPE_COUNT, 0);
+    }
+
+    //
+    // { "time_ms": { "interpret": 1.2, ... }, "count": { "chars": 10, ... } }
+    std::ostream& StatsTracker::record::to_json(std::ostream& o) const
+    {
+        o << "{\"" << SYMBOL_TIME_MS.name() << "\": {";
+        for (uint8_t p = 0; p < PHASE_TYPE_COUNT; p++) {
+            o << (p ? ", " : "") << '"' << SYMBOL_PHASES[p].name() << "\": " << to_ms(phases[p]);
+        }
+        o << "}, \"" << SYMBOL_COUNT.name() << "\": {";
+        for (uint8_t c = 0; c < COUNTER_TYPE_COUNT; c++) {
+            o << (c ? ", " : "") << '"' << SYMBOL_COUNTERS[c].name() << "\": " << counters[c];
+        }
+        o << "}}";
+        return o;
+    }
+
+    std::ostream& StatsTracker::record::to_edn(std::ostream& o) const
+    {
+        util::edn::Hash time_h(PHASE_TYPE_COUNT);
+        for (uint8_t p = 0; p < PHASE_TYPE_COUNT; p++) {
+            time_h.push( SYMBOL_PHASES[p], to_ms(phases[p]) );
+        }
+
+        util::edn::Hash count_h(COUNTER_TYPE_COUNT);
+        for (uint8_t c = 0; c < COUNTER_TYPE_COUNT; c++) {
+            count_h.push( SYMBOL_COUNTERS[c], counters[c] );
+        }
+
+        util::edn::Hash rec_h(2);
+        rec_h.push( SYMBOL_TIME_MS, time_h );
+        rec_h.push( SYMBOL_COUNT,   count_h );
+        o << rec_h;
+        return o;
+    }
+
+
+    // ========================================================
+    // tracker
+    //
+    void StatsTracker::begin_page(uintmax_t page_num)
+    {
+        if (enabled) {
+            pages.push_back( record(page_num) );
+            cur_page = &pages.back();
+        }
+    }
+
+    void StatsTracker::reset()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        totals = record();
+        pages.clear();
+        cur_page = nullptr;
+    }
+
+    void StatsTracker::add_time(phase_type p, clock::duration d)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        totals.phases[p] += d;
+        if (cur_page) {
+            cur_page->phases[p] += d;
+        }
+    }
+
+    //
+    // sidecar output: { "totals": {...}, "pages": [ {"pgnum": 0, ...}, ... ] }
+    std::ostream& StatsTracker::to_json(std::ostream& o) const
+    {
+        o << "{\"" << SYMBOL_TOTALS.name() << "\": ";
+        totals.to_json(o);
+        o << ",\n \"" << SYMBOL_PAGES.name() << "\": [";
+
+        bool first = true;
+        for (const record& r : pages) {
+            o << (first ? "\n  " : ",\n  ")
+              << "{\"" << SYMBOL_PAGE_NUMBER.name() << "\": " << r.page_num << ", \"" << SYMBOL_STATS.name() << "\": ";
+            r.to_json(o);
+            o << "}";
+            first = false;
+        }
+        o << "]}" << std::endl;
+        return o;
+    }
+
+    //
+    // EDN output mirrors the JSON output
+    std::ostream& StatsTracker::to_edn(std::ostream& o) const
+    {
+        util::edn::Vector pages_a(pages.size());
+        for (const record& r : pages) {
+            util::edn::Hash page_h(2);
+            page_h.push( SYMBOL_PAGE_NUMBER, r.page_num );
+            page_h.push( SYMBOL_STATS,       &r );
+            pages_a.push( page_h );
+        }
+
+        util::edn::Hash stats_h(2);
+        stats_h.push( SYMBOL_TOTALS, &totals );
+        stats_h.push( SYMBOL_PAGES,  pages_a );
+        o << stats_h;
+        return o;
+    }
+
+} // namespace
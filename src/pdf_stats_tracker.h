@@ -0,0 +1,166 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include "base_types.h"
+
+namespace pdftoedn
+{
+    // ----------------------------------
+    // collects per-page and document-wide timings and counters for
+    // the main processing phases. Collection is off unless enabled
+    // at startup (--stats) so timers and counters reduce to a flag
+    // check otherwise. Phase times are inclusive: time spent loading
+    // fonts or encoding images while poppler interprets the page is
+    // also part of the page's interpretation time. Image phases can
+    // run on worker threads so their totals can add up to more than
+    // the time it took to process the page
+    //
+    struct StatsTracker : public gemable {
+        enum phase_type {
+            PHASE_INTERPRET,
+            PHASE_FONT_LOAD,
+            PHASE_IMAGE_ENCODE,
+            PHASE_IMAGE_XFORM,
+            PHASE_MD5,
+            PHASE_IMAGE_WRITE,
+            PHASE_EDN_OUTPUT,
+
+            PHASE_TYPE_COUNT // delim
+        };
+
+        enum counter_type {
+            COUNT_CHARS,
+            COUNT_SPANS,
+            COUNT_PATHS,
+            COUNT_IMAGES_ENCODED,
+            COUNT_IMAGES_CACHED,
+            COUNT_IMAGES_PASSED_THROUGH,
+            COUNT_IMAGES_REUSED,
+            COUNT_IMAGES_FROM_CACHE,
+            COUNT_IMAGE_BYTES,
+            COUNT_EDN_BYTES,
+
+            COUNTER_TYPE_COUNT // delim
+        };
+
+        typedef std::chrono::steady_clock clock;
+
+        // ========================================================
+        // times a phase for the lifetime of the instance
+        //
+        class Timer {
+        public:
+            Timer(phase_type p);
+            ~Timer();
+
+        private:
+            phase_type phase;
+            bool active;
+            clock::time_point start;
+        };
+
+        static const Symbol SYMBOL_PHASES[];
+        static const Symbol SYMBOL_COUNTERS[];
+        static const Symbol SYMBOL_STATS;
+        static const Symbol SYMBOL_TOTALS;
+        static const Symbol SYMBOL_PAGES;
+        static const Symbol SYMBOL_PAGE_NUMBER;
+        static const Symbol SYMBOL_TIME_MS;
+        static const Symbol SYMBOL_COUNT;
+
+        StatsTracker() : enabled(false), paused(false), cur_page(nullptr) {}
+
+        void enable() { enabled = true; }
+        bool is_enabled() const { return enabled; }
+        // work that produces no output (e.g., pages replayed by
+        // --resume) is not collected while paused
+        void set_paused(bool p) { paused = p; }
+        bool is_collecting() const { return (enabled && !paused); }
+        // clear collected data (e.g., between documents processed
+        // in-process). The lock makes the tracker non-assignable
+        void reset();
+
+        // page records - data logged outside of a begin/end pair is
+        // only included in the document totals
+        void begin_page(uintmax_t page_num);
+        void end_page() { cur_page = nullptr; }
+
+        void add_time(phase_type p, clock::duration d);
+        void count(counter_type c, uintmax_t n = 1) {
+            if (is_collecting()) {
+                std::lock_guard<std::mutex> guard(lock);
+                totals.counters[c] += n;
+                if (cur_page) {
+                    cur_page->counters[c] += n;
+                }
+            }
+        }
+
+        // document totals
+        clock::duration total_time(phase_type p) const { return totals.phases[p]; }
+        uintmax_t total_count(counter_type c) const     { return totals.counters[c]; }
+        uintmax_t num_pages() const                     { return pages.size(); }
+
+        std::ostream& to_json(std::ostream& o) const;
+        virtual std::ostream& to_edn(std::ostream& o) const;
+
+    private:
+        struct record : public gemable {
+            uintmax_t page_num;
+            clock::duration phases[PHASE_TYPE_COUNT];
+            uintmax_t counters[COUNTER_TYPE_COUNT];
+
+            record(uintmax_t pg = 0);
+
+            std::ostream& to_json(std::ostream& o) const;
+            virtual std::ostream& to_edn(std::ostream& o) const;
+        };
+
+        bool enabled;
+        bool paused;
+        record totals;
+        std::vector<record> pages;
+        record* cur_page;
+        std::mutex lock;
+    };
+
+    extern pdftoedn::StatsTracker stats;
+
+    // timers are created at every instrumented call so keep them
+    // inlined
+    inline StatsTracker::Timer::Timer(phase_type p) :
+        phase(p), active(stats.is_collecting())
+    {
+        if (active) {
+            start = clock::now();
+        }
+    }
+
+    inline StatsTracker::Timer::~Timer()
+    {
+        if (active) {
+            stats.add_time(phase, clock::now() - start);
+        }
+    }
+} // namespace
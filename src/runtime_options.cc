@@ -18,9 +18,18 @@
 
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <ostream>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
 #include <boost/filesystem.hpp>
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #ifdef CHECK_PDF_COOKIE
 #include <boost/regex.hpp>
 #endif
@@ -35,8 +44,14 @@
 namespace pdftoedn {
 
     static const std::string EDN_FILE_EXT      = ".edn";
-    static const std::string IMAGE_FILE_EXT    = ".png";
     static const std::string FONT_MAP_FILE_EXT = ".json";
+    static const std::string STATS_FILE_EXT    = ".stats.json";
+
+    // base name for image files when neither input nor output have a
+    // file name to derive it from
+    static const std::string STDIO_DOC_BASE_NAME = "doc";
+
+    const std::string Options::STDIO_FILENAME  = "-";
 
     static const std::string DEFAULT_CONFIG_DIR = util::expand_environment_variables("${HOME}") + "/.pdftoedn/";
 
@@ -61,6 +76,152 @@ namespace pdftoedn {
     }
 #endif
 
+    // ======================================================================
+    // page ranges
+    //
+    const uintmax_t PageRanges::OPEN_END = std::numeric_limits<uintmax_t>::max();
+
+    PageRanges PageRanges::parse(const std::string& spec)
+    {
+        PageRanges pr;
+
+        if (!spec.empty() && spec[0] == '@') {
+            // read the list from a file
+            std::string filename = util::fs::expand_path(spec.substr(1));
+            char* data;
+            if (!util::fs::read_text_file(filename, &data)) {
+                throw std::logic_error("Error reading page list file '" + filename + "'.");
+            }
+            std::string contents(data);
+            delete [] data;
+            pr.add_ranges(contents);
+        } else {
+            pr.add_ranges(spec);
+        }
+
+        if (pr.empty()) {
+            throw std::logic_error("No pages given in page list '" + spec + "'.");
+        }
+        return pr;
+    }
+
+    //
+    // entries are separated by commas or whitespace. Each is a page
+    // number, a closed range (N-M), or an open-ended one (N-)
+    void PageRanges::add_ranges(const std::string& spec)
+    {
+        std::string s(spec);
+        std::replace(s.begin(), s.end(), ',', ' ');
+
+        std::istringstream entries(s);
+        std::string entry;
+        while (entries >> entry) {
+            std::string::size_type dash = entry.find('-');
+            std::string first_str = entry.substr(0, dash);
+            std::string last_str = (dash != std::string::npos ? entry.substr(dash + 1) : first_str);
+
+            auto is_digit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+            bool valid = (!first_str.empty() &&
+                          std::all_of(first_str.begin(), first_str.end(), is_digit) &&
+                          std::all_of(last_str.begin(), last_str.end(), is_digit));
+            uintmax_t first = 0, last = OPEN_END;
+            if (valid) {
+                first = std::stoull(first_str);
+                if (!last_str.empty()) {
+                    last = std::stoull(last_str);
+                }
+                valid = (first <= last);
+            }
+
+            if (!valid) {
+                throw std::logic_error("Invalid page range '" + entry + "' (page numbers are 0-indexed; use N, N-M, or N-).");
+            }
+            ranges.push_back( std::make_pair(first, last) );
+        }
+    }
+
+    uintmax_t PageRanges::first_invalid_page(uintmax_t num_pages) const
+    {
+        for (const std::pair<uintmax_t, uintmax_t>& r : ranges) {
+            if (r.first >= num_pages) {
+                return r.first;
+            }
+            if (r.second != OPEN_END && r.second >= num_pages) {
+                return r.second;
+            }
+        }
+        return OPEN_END;
+    }
+
+    std::vector<uintmax_t> PageRanges::page_list(uintmax_t num_pages) const
+    {
+        std::vector<uintmax_t> pg_list;
+        for (const std::pair<uintmax_t, uintmax_t>& r : ranges) {
+            for (uintmax_t pg = r.first; pg <= r.second && pg < num_pages; ++pg) {
+                pg_list.push_back(pg);
+            }
+        }
+
+        std::sort(pg_list.begin(), pg_list.end());
+        pg_list.erase(std::unique(pg_list.begin(), pg_list.end()), pg_list.end());
+        return pg_list;
+    }
+
+    std::ostream& operator<<(std::ostream& o, const PageRanges& pr)
+    {
+        bool first = true;
+        for (const std::pair<uintmax_t, uintmax_t>& r : pr.ranges) {
+            o << (first ? "" : ",") << r.first;
+            if (r.second == PageRanges::OPEN_END) {
+                o << "-";
+            } else if (r.second != r.first) {
+                o << "-" << r.second;
+            }
+            first = false;
+        }
+        return o;
+    }
+
+
+    // ======================================================================
+    // image codecs
+    //
+    static const char* IMAGE_CODEC_NAMES[ImageCodec::CODEC_COUNT] = {
+        "png_fast", "png", "png_best", "qoi", "webp_lossless", "jpeg", "jpx"
+    };
+    static const char* IMAGE_CODEC_FILE_EXTS[ImageCodec::CODEC_COUNT] = {
+        ".png", ".png", ".png", ".qoi", ".webp", ".jpg", ".jp2"
+    };
+
+    ImageCodec ImageCodec::parse(const std::string& name)
+    {
+        for (int i = 0; i < CODEC_COUNT; i++) {
+            // passthrough formats can't be selected
+            if (name != IMAGE_CODEC_NAMES[i] || ImageCodec(static_cast<codec_type>(i)).is_passthrough()) {
+                continue;
+            }
+#ifndef HAVE_LIBWEBP
+            if (i == WEBP_LOSSLESS) {
+                throw std::logic_error("webp_lossless images are not supported by this build.");
+            }
+#endif
+            return ImageCodec(static_cast<codec_type>(i));
+        }
+        throw std::logic_error("Unsupported image codec '" + name +
+                               "' (use 'png_fast', 'png', 'png_best', 'qoi' or 'webp_lossless').");
+    }
+
+    const char* ImageCodec::name() const
+    {
+        return IMAGE_CODEC_NAMES[type];
+    }
+
+    const char* ImageCodec::file_ext() const
+    {
+        return IMAGE_CODEC_FILE_EXTS[type];
+    }
+
+
     // ======================================================================
     // constructor
     //
@@ -70,16 +231,17 @@ namespace pdftoedn {
                      const std::string& edn_filename,
                      const std::string& fontmap,
                      const Flags& f,
-                     intmax_t pg_num) :
+                     intmax_t pg_num,
+                     const Settings& s) :
         src_pdf_filename(pdf_filename),
         src_pdf_owner_password(pdf_owner_password), src_pdf_user_password(pdf_user_password),
-        out_edn_filename(edn_filename), flags(f), page_num(pg_num)
+        out_edn_filename(edn_filename), flags(f), page_num(pg_num), settings(s)
     {
         namespace fs = boost::filesystem;
         fs::path file_path = src_pdf_filename;
 
-        // check input file
-        if (util::fs::check_valid_input_file(file_path)) {
+        // check input file - nothing to check if reading from stdin
+        if (!pdf_from_stdin() && util::fs::check_valid_input_file(file_path)) {
 #ifdef CHECK_PDF_COOKIE
             if (!check_pdf_cookie(src_pdf_filename)) {
                 std::stringstream ss;
@@ -93,6 +255,16 @@ namespace pdftoedn {
         fs::path output_filepath = out_edn_filename;
         fs::path parent_path(output_filepath.parent_path());
 
+        // when writing to stdout, there's no output folder to place
+        // images in so one must be given unless none will be written
+        if (edn_to_stdout() && settings.image_dir.empty() &&
+            !(flags.edn_output_only || flags.link_output_only || flags.text_output_only)) {
+            throw invalid_file("an image directory (--image_dir) is required when writing output to stdout");
+        }
+        if (edn_to_stdout() && flags.shard_pages) {
+            throw invalid_file("page shards can't be written to stdout");
+        }
+
         // output file path is required and will have to be created so
         // check that its parent path exists
         if (!parent_path.empty()) {
@@ -105,7 +277,7 @@ namespace pdftoedn {
         }
 
         // check if the destination file exists
-        if (fs::exists(output_filepath))
+        if (!edn_to_stdout() && fs::exists(output_filepath))
         {
             if (output_filepath == file_path) {
                 // trying to overwrite the PDF? interesting...
@@ -115,8 +287,18 @@ namespace pdftoedn {
                 throw invalid_file(err.str());
             }
 
+            // page shards are written into a directory. Files in it
+            // are overwritten (or kept, if resuming) so it's left as
+            // is
+            if (flags.shard_pages && fs::is_directory(output_filepath)) {
+                if (!flags.force_output_write && !flags.resume) {
+                    std::stringstream err;
+                    err << output_filepath << " destination folder exists";
+                    throw invalid_file(err.str());
+                }
+            }
             // remove the file if asked to do so
-            if (flags.force_output_write) {
+            else if (flags.force_output_write) {
                 // but check if it's a file that can be deleted
                 if (!fs::is_regular_file(output_filepath)) {
                     std::stringstream err;
@@ -135,13 +317,21 @@ namespace pdftoedn {
         // font maps
         load_font_maps(fontmap);
 
-        // configure some useful paths, etc.
-        doc_base_name = output_filepath.stem().string();
+        // configure some useful paths, etc. Names are based on the
+        // output file or, if writing to stdout, the input file
+        if (!edn_to_stdout()) {
+            doc_base_name = output_filepath.stem().string();
+        } else if (!pdf_from_stdin()) {
+            doc_base_name = file_path.stem().string();
+        } else {
+            doc_base_name = STDIO_DOC_BASE_NAME;
+        }
 
         // determine the resource directory based on the output path
-        // but don't create it yet as some documents might not have
-        // images, etc. that will need saving.
-        fs::path res_dir = (parent_path / doc_base_name);
+        // (unless one was given) but don't create it yet as some
+        // documents might not have images, etc. that will need
+        // saving.
+        fs::path res_dir = (settings.image_dir.empty() ? (parent_path / doc_base_name) : fs::path(settings.image_dir));
 
         // but, if it exists, make sure it's a directory
         if (fs::exists(res_dir) && !fs::is_directory(res_dir)) {
@@ -151,6 +341,37 @@ namespace pdftoedn {
         }
         resource_dir = res_dir.string();
 
+        // files mapped for images over --image_memory_limit are kept
+        // with the images instead of in the temp directory as it may
+        // be backed by memory. Without images, they go next to the
+        // output
+        if (!settings.scratch_dir.empty()) {
+            if (!fs::is_directory(settings.scratch_dir)) {
+                std::stringstream err;
+                err << settings.scratch_dir << " scratch path is not a folder";
+                throw invalid_file(err.str());
+            }
+            scratch_path = settings.scratch_dir;
+        } else if (!flags.edn_output_only) {
+            scratch_path = resource_dir;
+        } else {
+            scratch_path = (parent_path.empty() ? fs::path(".") : parent_path).string();
+        }
+
+        // the image cache is shared between runs so create it now
+        if (!settings.image_cache_dir.empty() && !util::fs::create_fs_dir(settings.image_cache_dir)) {
+            std::stringstream err;
+            err << settings.image_cache_dir << " image cache folder can't be created";
+            throw invalid_file(err.str());
+        }
+
+        // stats are written next to the output file or, if writing
+        // to stdout, in the image directory
+        if (flags.collect_stats) {
+            fs::path stats_path = ((edn_to_stdout() && !settings.image_dir.empty()) ? res_dir : parent_path);
+            stats_file = (stats_path / (doc_base_name + STATS_FILE_EXT)).string();
+        }
+
         //        std::cerr << *this << std::endl;
     }
 
@@ -224,7 +445,25 @@ namespace pdftoedn {
 
     //
     // create absolute and relative image paths
-    bool Options::get_image_path(intmax_t img_id, std::string& image_path, bool create_res_dir) const
+    bool Options::get_image_path(intmax_t img_id, const ImageCodec& codec, std::string& image_path,
+                                 bool create_res_dir) const
+    {
+        std::stringstream image_name;
+        image_name << doc_base_name << "-" << img_id;
+        return make_image_path(image_name.str(), codec, image_path, create_res_dir);
+    }
+
+    //
+    // images named by the md5 of their data (--dedup_images) so
+    // identical ones share a file
+    bool Options::get_image_path(const std::string& md5, const ImageCodec& codec, std::string& image_path,
+                                 bool create_res_dir) const
+    {
+        return make_image_path(md5, codec, image_path, create_res_dir);
+    }
+
+    bool Options::make_image_path(const std::string& name, const ImageCodec& codec, std::string& image_path,
+                                  bool create_res_dir) const
     {
         boost::filesystem::path file_path(resource_dir);
 
@@ -234,10 +473,7 @@ namespace pdftoedn {
         }
 
         // create the absolute path name for the image file
-        std::stringstream image_filename;
-        image_filename << doc_base_name << "-" << img_id << IMAGE_FILE_EXT;
-
-        file_path.append(image_filename.str());
+        file_path.append(name + codec.file_ext());
         image_path = file_path.string();
         return true;
     }
@@ -268,7 +504,7 @@ namespace pdftoedn {
         {
             // image path test
             std::string test;
-            opt.get_image_path(1, test, false);
+            opt.get_image_path(1, opt.settings.image_codec, test, false);
             o << "   Image output test: \"" << test << '"' << std::endl
               << "   Relative img test: \"" << opt.get_image_rel_path(test) << '"' << std::endl;
         }
@@ -277,10 +513,37 @@ namespace pdftoedn {
             o << "   Font map file:     \"" << opt.font_map << '"' << std::endl;
         }
 
+        if (!opt.stats_file.empty()) {
+            o << "   Stats file:        \"" << opt.stats_file << '"' << std::endl;
+        }
+
         if (opt.page_num != -1) {
             o << "   req'd page number: " <<opt.page_num;
         }
 
+        if (!opt.settings.pages.empty()) {
+            o << "   req'd pages:       " << opt.settings.pages << std::endl;
+        }
+
+        if (opt.settings.image_workers > 0) {
+            o << "   Image workers:     " << opt.settings.image_workers << std::endl;
+        }
+
+        o << "   Image codec:       " << opt.settings.image_codec.name() << std::endl;
+
+        if (opt.settings.max_image_dpi > 0) {
+            o << "   Max image DPI:     " << opt.settings.max_image_dpi << std::endl;
+        }
+
+        if (opt.settings.image_memory_limit > 0) {
+            o << "   Image mem limit:   " << (opt.settings.image_memory_limit / (1024 * 1024)) << " MB" << std::endl;
+            o << "   Scratch path:      \"" << opt.scratch_path << '"' << std::endl;
+        }
+
+        if (!opt.settings.image_cache_dir.empty()) {
+            o << "   Image cache:       \"" << opt.settings.image_cache_dir << '"' << std::endl;
+        }
+
         std::list<std::string> opts;
         if (opt.flags.omit_outline)
             opts.push_back("omit_outline");
@@ -294,12 +557,22 @@ namespace pdftoedn {
             opts.push_back("links_only");
         if (opt.flags.include_debug_info)
             opts.push_back("debug_info");
-        if (opt.flags.libpng_use_best_compression)
-            opts.push_back("png_best_comp");
         if (opt.flags.force_font_preprocess)
             opts.push_back("font_preprocess");
         if (opt.flags.force_output_write)
             opts.push_back("force_output_write");
+        if (opt.flags.collect_stats)
+            opts.push_back("collect_stats");
+        if (opt.flags.mmap_input)
+            opts.push_back("mmap_input");
+        if (opt.flags.shard_pages)
+            opts.push_back("shard_pages");
+        if (opt.flags.resume)
+            opts.push_back("resume");
+        if (opt.flags.image_passthrough)
+            opts.push_back("image_passthrough");
+        if (opt.flags.dedup_images)
+            opts.push_back("dedup_images");
 
         if (!opts.empty()) {
             o << "   Flags:             ";
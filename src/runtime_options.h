@@ -19,9 +19,79 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
 
 namespace pdftoedn {
 
+    //
+    // set of 0-indexed page ranges selected with --pages. Ranges can
+    // be open-ended so they are only resolved to a page list once
+    // the number of pages in the document is known
+    class PageRanges
+    {
+    public:
+        static const uintmax_t OPEN_END;
+
+        PageRanges() {}
+
+        // parses "0-4,9,19-" or "@file" to read the list from a
+        // file. Throws std::logic_error if the spec is invalid
+        static PageRanges parse(const std::string& spec);
+
+        bool empty() const { return ranges.empty(); }
+
+        // returns the first page that is outside of the document or
+        // OPEN_END if all are valid
+        uintmax_t first_invalid_page(uintmax_t num_pages) const;
+
+        // sorted list of unique pages in the document
+        std::vector<uintmax_t> page_list(uintmax_t num_pages) const;
+
+        friend std::ostream& operator<<(std::ostream& o, const PageRanges& pr);
+
+    private:
+        // inclusive [first, last] pairs in the order given
+        std::vector<std::pair<uintmax_t, uintmax_t> > ranges;
+
+        void add_ranges(const std::string& spec);
+    };
+
+    //
+    // format images are written in (--image_codec). The PNG profiles
+    // trade encoding speed for file size; qoi and webp_lossless are
+    // alternatives for consumers that read them. JPEG and JPX streams
+    // are only written as they are stored in the document
+    // (--image_passthrough)
+    struct ImageCodec
+    {
+        enum codec_type {
+            PNG_FAST,
+            PNG,
+            PNG_BEST,
+            QOI,
+            WEBP_LOSSLESS,
+            JPEG,
+            JPX,
+
+            CODEC_COUNT
+        };
+
+        ImageCodec(codec_type t = PNG) : type(t) {}
+
+        // throws std::logic_error if the name is unknown or the
+        // codec is not supported by this build
+        static ImageCodec parse(const std::string& name);
+
+        const char* name() const;
+        const char* file_ext() const;
+        bool is_png() const { return (type == PNG_FAST || type == PNG || type == PNG_BEST); }
+        bool is_passthrough() const { return (type == JPEG || type == JPX); }
+
+        codec_type type;
+    };
+
     class Options
     {
     public:
@@ -34,13 +104,35 @@ namespace pdftoedn {
             bool link_output_only;
             bool edn_output_only;
             bool include_debug_info;
-            bool libpng_use_best_compression;
             bool force_font_preprocess;
             bool force_output_write;
             bool text_output_only;
             bool gfx_output_only;
+            bool collect_stats;
+            bool mmap_input;
+            bool shard_pages;
+            bool resume;
+            bool image_passthrough;
+            bool dedup_images;
+        };
+
+        // output and image settings that take a value
+        struct Settings {
+            Settings() : image_workers(0), max_image_dpi(0), image_memory_limit(0) {}
+
+            std::string image_dir;
+            PageRanges pages;
+            uintmax_t image_workers;
+            ImageCodec image_codec;
+            uintmax_t max_image_dpi;
+            std::string image_cache_dir;
+            uintmax_t image_memory_limit; // in bytes
+            std::string scratch_dir;
         };
 
+        // file name used for stdin / stdout
+        static const std::string STDIO_FILENAME;
+
         Options() : page_num(-1) {}
         Options(const std::string& font_map) :
             page_num(-1) {
@@ -52,17 +144,32 @@ namespace pdftoedn {
                 const std::string& edn_filename,
                 const std::string& font_map,
                 const Flags& f,
-                intmax_t pg_num);
+                intmax_t pg_num,
+                const Settings& s = Settings());
 
         const std::string& pdf_filename() const  { return src_pdf_filename; }
         const std::string& edn_filename() const  { return out_edn_filename; }
         const std::string& outputdir() const     { return output_path; }
+        const std::string& stats_filename() const { return stats_file; }
         intmax_t page_number() const             { return page_num; }
+        const PageRanges& page_ranges() const    { return settings.pages; }
+        uintmax_t image_workers() const          { return settings.image_workers; }
+        const ImageCodec& image_codec() const    { return settings.image_codec; }
+        uintmax_t max_image_dpi() const          { return settings.max_image_dpi; }
+        const std::string& image_cache_dir() const { return settings.image_cache_dir; }
+        // in bytes
+        uintmax_t image_memory_limit() const     { return settings.image_memory_limit; }
+        const std::string& scratch_dir() const   { return scratch_path; }
+        bool pdf_from_stdin() const              { return (src_pdf_filename == STDIO_FILENAME); }
+        bool edn_to_stdout() const               { return (out_edn_filename == STDIO_FILENAME); }
 
         const std::string& pdf_owner_password() const { return src_pdf_owner_password; }
         const std::string& pdf_user_password() const  { return src_pdf_user_password; }
 
-        bool get_image_path(intmax_t id, std::string& abs_file_path, bool create_res_dir = true) const;
+        bool get_image_path(intmax_t id, const ImageCodec& codec, std::string& abs_file_path,
+                            bool create_res_dir = true) const;
+        bool get_image_path(const std::string& md5, const ImageCodec& codec, std::string& abs_file_path,
+                            bool create_res_dir = true) const;
         std::string get_image_rel_path(const std::string& abs_path) const;
 
         bool omit_outline() const                { return flags.omit_outline; }
@@ -71,12 +178,17 @@ namespace pdftoedn {
         bool include_invisible_text() const      { return flags.include_invisible_text; }
         bool link_output_only() const            { return flags.link_output_only; }
         bool edn_output_only() const             { return flags.edn_output_only; }
-        bool libpng_use_best_compression() const { return flags.libpng_use_best_compression; }
         bool include_debug_info() const          { return flags.include_debug_info; }
         bool force_pre_process_fonts() const     { return flags.force_font_preprocess; }
         bool force_output_write() const          { return flags.force_output_write; }
         bool text_output_only() const            { return flags.text_output_only; }
         bool gfx_output_only() const             { return flags.gfx_output_only; }
+        bool collect_stats() const               { return flags.collect_stats; }
+        bool mmap_input() const                  { return flags.mmap_input; }
+        bool shard_pages() const                 { return flags.shard_pages; }
+        bool resume() const                      { return flags.resume; }
+        bool image_passthrough() const           { return flags.image_passthrough; }
+        bool dedup_images() const                { return flags.dedup_images; }
 
         friend std::ostream& operator<<(std::ostream& o, const Options& opt);
 
@@ -88,10 +200,15 @@ namespace pdftoedn {
         std::string font_map;
         Flags flags;
         intmax_t page_num;
+        Settings settings;
         std::string output_path;
         std::string resource_dir;
+        std::string scratch_path;
         std::string doc_base_name;
+        std::string stats_file;
 
+        bool make_image_path(const std::string& name, const ImageCodec& codec, std::string& image_path,
+                             bool create_res_dir) const;
         bool load_font_maps(const std::string& font_map_file);
         bool load_font_map_file(const std::string& new_font_map_file);
     };
@@ -63,84 +63,10 @@ namespace pdftoedn
     //
 
     //
-    // check if this character looks to be adjacent to a previous one
-    bool PdfChar::spans(const PdfChar& prev) const
-    {
-        // if we have rotation but are not rotation along 90, 180, or
-        // 270, we don't bother computing span
-        if (!ctm.is_rotation_orthogonal()) {
-            return false;
-        }
-
-        // check that text looks like it might actually follow the
-        // previous character
-        if (prev.x1() > x2()) {
-            return false;
-        }
-
-        double scaling = attribs.txt.font_size * metrics.horiz_scaling;
-        double max_gap = 1.2 * scaling;
-        double max_space = max_gap * 1.1;
-
-        // found cases where a very large whitespace is used to
-        // separate text spans in table cells, footers, etc.
-        if (prev.is_space() && (prev.width() > max_space)) {
-            return false;
-        }
-
-        double bbox_delta = left() - prev.right();
-        if (ctm.rotation_deg() == 90) {
-            // TESLA-7613: when text is rotated by 90, left -
-            // prev.right results in a negative value due to inverted
-            // y axis. Compensate here so the calculation below works
-            bbox_delta = std::abs(bbox_delta);
-        }
-
-        // if we're dealing with a glyph, or text attributes are not
-        // equal or the position delta is not within some magic
-        // numbers, it is not spannable
-        if (glyph_idx != -1) {
-            return false;
-        }
-
-        // different line?
-        if (std::abs(prev.top() - top()) > 0.001) {
-            return false;
-        }
-
-        // different rotation?
-        if (ctm.rotation() != prev.ctm.rotation()) {
-            return false;
-        }
-
-        // attributes match?
-        if (attribs != prev.attribs) {
-            return false;
-        }
-
-        double min_ws_space = 0.2 * scaling;
-
-        // attribs comparison included link index but, if it's
-        // set (!= -1), then don't break up the span since it's
-        // on the same line
-        if ((attribs.txt.link_idx == -1) &&
-            // if there's a gap, only break it up if they're both not whitespace
-            (((bbox_delta > min_ws_space) && (!prev.is_space() && !is_space())) ||
-             // or if it's a large gap, split it
-             ( bbox_delta > max_gap )
-                )) {
-            return false;
-        } else {
-            // it's in a link - split only if space looks too big
-            if ( bbox_delta > max_gap ) {
-                return false;
-            }
-        }
-
-        return true;
-    }
-
-    double PdfChar::left() const
+    // coordinate of x-most vertex for the given position, taking
+    // in account rotation. Shared by PdfChar and the char buffer in
+    // PdfText
+    static double char_left(const BoundingBox& bbox, const PdfTM& ctm)
     {
         if (!ctm.is_rotated()) {
             return bbox.x_min();
@@ -159,7 +85,7 @@ namespace pdftoedn
         }
     }
 
-    double PdfChar::right() const
+    static double char_right(const BoundingBox& bbox, const PdfTM& ctm)
     {
         if (!ctm.is_rotated()) {
             return bbox.x_max();
@@ -178,7 +104,7 @@ namespace pdftoedn
         }
     }
 
-    double PdfChar::top() const
+    static double char_top(const BoundingBox& bbox, const PdfTM& ctm)
     {
         if (!ctm.is_rotated()) {
             return bbox.y_min();
@@ -197,7 +123,7 @@ namespace pdftoedn
         }
     }
 
-    double PdfChar::bottom() const
+    static double char_bottom(const BoundingBox& bbox, const PdfTM& ctm)
     {
         if (!ctm.is_rotated()) {
             return bbox.y_max();
@@ -216,6 +142,58 @@ namespace pdftoedn
         }
     }
 
+    double PdfChar::left() const   { return char_left(bbox, ctm); }
+    double PdfChar::right() const  { return char_right(bbox, ctm); }
+    double PdfChar::top() const    { return char_top(bbox, ctm); }
+    double PdfChar::bottom() const { return char_bottom(bbox, ctm); }
+
+
+    // =============================================
+    // PdfText::CharBuffer - struct-of-arrays character storage
+    //
+    void PdfText::CharBuffer::push_back(const PdfChar& c)
+    {
+        unicode.push_back(c.unicode);
+        x1.push_back(c.x1);
+        y1.push_back(c.y1);
+        w.push_back(c.w);
+        h.push_back(c.h);
+        glyph_idx.push_back(c.glyph_idx);
+    }
+
+    void PdfText::CharBuffer::pop_back()
+    {
+        unicode.pop_back();
+        x1.pop_back();
+        y1.pop_back();
+        w.pop_back();
+        h.pop_back();
+        glyph_idx.pop_back();
+    }
+
+    //
+    // copy the entry at index 'from' into 'to' - used to compact
+    // the buffer when removing characters
+    void PdfText::CharBuffer::move(uintmax_t from, uintmax_t to)
+    {
+        unicode[to]   = unicode[from];
+        x1[to]        = x1[from];
+        y1[to]        = y1[from];
+        w[to]         = w[from];
+        h[to]         = h[from];
+        glyph_idx[to] = glyph_idx[from];
+    }
+
+    void PdfText::CharBuffer::resize(uintmax_t n)
+    {
+        unicode.resize(n);
+        x1.resize(n);
+        y1.resize(n);
+        w.resize(n);
+        h.resize(n);
+        glyph_idx.resize(n);
+    }
+
 
     // =============================================
     // PdfText - a span of PdfChars
@@ -249,35 +227,125 @@ namespace pdftoedn
     {
         while (!chars.empty())
         {
-            if (!chars.back()->is_space()) {
+            if (!chars.is_space(chars.size() - 1)) {
                 break;
             }
-            delete chars.back();
             chars.pop_back();
         }
     }
 
+    //
+    // check if the character looks to be adjacent to the last one
+    // in the span
+    bool PdfText::spans(const PdfChar& c) const
+    {
+        // if we have rotation but are not rotation along 90, 180, or
+        // 270, we don't bother computing span
+        if (!c.ctm.is_rotation_orthogonal()) {
+            return false;
+        }
+
+        // the previous character
+        uintmax_t prev = chars.size() - 1;
+        const BoundingBox prev_bbox = chars.bounding_box(prev);
+        bool prev_is_space = chars.is_space(prev);
+
+        // check that text looks like it might actually follow the
+        // previous character
+        if (prev_bbox.x1() > c.bbox.x2()) {
+            return false;
+        }
+
+        double scaling = c.txt.font_size * c.metrics.horiz_scaling;
+        double max_gap = 1.2 * scaling;
+        double max_space = max_gap * 1.1;
+
+        // found cases where a very large whitespace is used to
+        // separate text spans in table cells, footers, etc.
+        if (prev_is_space && (prev_bbox.width() > max_space)) {
+            return false;
+        }
+
+        double bbox_delta = c.left() - char_right(prev_bbox, last_ctm);
+        if (c.ctm.rotation_deg() == 90) {
+            // TESLA-7613: when text is rotated by 90, left -
+            // prev.right results in a negative value due to inverted
+            // y axis. Compensate here so the calculation below works
+            bbox_delta = std::abs(bbox_delta);
+        }
+
+        // if we're dealing with a glyph, or text attributes are not
+        // equal or the position delta is not within some magic
+        // numbers, it is not spannable
+        if (c.glyph_idx != -1) {
+            return false;
+        }
+
+        // different line?
+        if (std::abs(char_top(prev_bbox, last_ctm) - c.top()) > 0.001) {
+            return false;
+        }
+
+        // different rotation?
+        if (c.ctm.rotation() != last_ctm.rotation()) {
+            return false;
+        }
+
+        // attributes match? All chars in the span share the same
+        // ones so compare against the span's
+        if ( (c.txt != attribs.txt) ||
+             ((c.gfx != attribs.gfx) && (c.gfx->fill != attribs.gfx->fill)) ||
+             (c.clip_path_id != attribs.clip_path_id) ) {
+            return false;
+        }
+
+        double min_ws_space = 0.2 * scaling;
+
+        // attribs comparison included link index but, if it's
+        // set (!= -1), then don't break up the span since it's
+        // on the same line
+        if ((c.txt.link_idx == -1) &&
+            // if there's a gap, only break it up if they're both not whitespace
+            (((bbox_delta > min_ws_space) && (!prev_is_space && !c.is_space())) ||
+             // or if it's a large gap, split it
+             ( bbox_delta > max_gap )
+                )) {
+            return false;
+        } else {
+            // it's in a link - split only if space looks too big
+            if ( bbox_delta > max_gap ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     //
     // store / append a new character
-    bool PdfText::push_back(PdfChar* c)
+    bool PdfText::push_back(const PdfChar& c)
     {
         // is there a span created?
         if (chars.empty())
         {
             // no. get the char data and set it for the span
-            ctm = c->ctm;
-            attribs = c->attribs; // all other common attributes
+            ctm = c.ctm;
+            // all other common attributes
+            attribs.txt = c.txt;
+            attribs.gfx = c.gfx;
+            attribs.clip_path_id = c.clip_path_id;
         }
         else
         {
             // don't append back to back white-space
-            if (chars.back()->is_space() && c->is_space()) {
+            if (chars.is_space(chars.size() - 1) && c.is_space()) {
                 return false;
             }
         }
 
         // add the character now
         chars.push_back(c);
+        last_ctm = c.ctm;
         return true;
     }
 
@@ -297,9 +365,9 @@ namespace pdftoedn
         trim();
         if (!chars.empty()) {
             Bounds b;
-            b = chars.front()->bounding_box();
+            b = chars.bounding_box(0);
             if (chars.size() > 1) {
-                b.expand(chars.back()->bounding_box());
+                b.expand(chars.bounding_box(chars.size() - 1));
             }
             bbox = b.bounding_box();
         }
@@ -310,24 +378,34 @@ namespace pdftoedn
     // remove characters from the span covered by the region
     void PdfText::whiteout(const BoundingBox& wo_region)
     {
-        auto char_it = chars.begin();
-
-        while (char_it != chars.end())
+        // compact the buffer in place, skipping the characters
+        // covered by the region. Chars in a span share its rotation
+        // so its CTM is used
+        uintmax_t num_chars = chars.size();
+        uintmax_t kept = 0;
+        bool past_region = false;
+
+        for (uintmax_t i = 0; i < num_chars; ++i)
         {
-            auto cur_it = char_it++;
-            PdfChar* c = *cur_it;
-
-            if (c->right() < wo_region.x_min()) {
-                continue;
+            if (!past_region) {
+                const BoundingBox c_bbox = chars.bounding_box(i);
+
+                if (char_right(c_bbox, ctm) >= wo_region.x_min()) {
+                    if (char_left(c_bbox, ctm) > wo_region.x_max()) {
+                        past_region = true;
+                    } else {
+                        // covered - drop it
+                        continue;
+                    }
+                }
             }
 
-            if (c->left() > wo_region.x_max()) {
-                break;
+            if (kept != i) {
+                chars.move(i, kept);
             }
-
-            delete c;
-            chars.erase(cur_it);
+            ++kept;
         }
+        chars.resize(kept);
 
         finalize();
     }
@@ -436,30 +514,27 @@ namespace pdftoedn
         // run through the list of characters to build the string and
         // the x-position vector..
         util::edn::Vector x_vector_a(chars.size());
-        std::string str;
-        intmax_t glyph_idx = -1;
+        std::string str = util::wstring_to_utfstring(chars.unicode);
 
-        for (const PdfChar* c : chars) {
-            str += util::wstring_to_utfstring(c->wstr());
-
-            if (!ctm.is_rotated()) {
-                x_vector_a.push( c->bounding_box().x1() );
+        if (!ctm.is_rotated()) {
+            for (uintmax_t i = 0; i < chars.size(); ++i) {
+                x_vector_a.push( chars.bounding_box(i).x1() );
             }
-
-            // if a glyph was encountered in the stream, length will
-            // be 1 always since they're not spannable
-            glyph_idx = c->get_glyph_index();
         }
 
+        // if a glyph was encountered in the stream, length will be 1
+        // always since they're not spannable
+        intmax_t glyph_idx = (chars.empty() ? -1 : chars.glyph_idx.back());
+
         text_h.push( SYMBOL_TEXT,                    str );
 
         // font and color data
         text_h.push( PdfPage::SYMBOL_FONT_IDX,       attribs.txt.font_idx );
         text_h.push( SYMBOL_PT_SIZE,                 font_size );
 
-        text_h.push( PdfPage::SYMBOL_COLOR_IDX,      attribs.gfx.fill.color_idx );
-        if (attribs.gfx.fill.opacity != 1.0) {
-            text_h.push( PdfPage::SYMBOL_OPACITY,    attribs.gfx.fill.opacity );
+        text_h.push( PdfPage::SYMBOL_COLOR_IDX,      attribs.gfx->fill.color_idx );
+        if (attribs.gfx->fill.opacity != 1.0) {
+            text_h.push( PdfPage::SYMBOL_OPACITY,    attribs.gfx->fill.opacity );
         }
 
         text_h.push( SYMBOL_X_POS_VECTOR,            x_vector_a );
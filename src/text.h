@@ -19,7 +19,9 @@
 #pragma once
 
 #include <ostream>
-#include <list>
+#include <string>
+#include <vector>
+#include <cwctype>
 #include "util.h"
 #include "base_types.h"
 #include "graphics.h"
@@ -74,26 +76,28 @@ namespace pdftoedn
     };
 
     // -------------------------------------------------------
-    // Pdf unicode character. Used to form PdfText spans.
+    // Pdf unicode character. Transient candidate built for each
+    // character found in the PDF and used to form PdfText spans -
+    // only its position and code point are retained by the span.
+    // Attributes and metrics are referenced, not copied, so it must
+    // not outlive them. Gfx attribs are interned by the page
     //
-    class PdfChar : public PdfBoxedItem {
+    class PdfChar {
     public:
-        PdfChar(const BoundingBox& bbox,
+        PdfChar(double x, double y, double width, double height,
                 const PdfTM& text_ctm, uintmax_t unicode_c,
-                const TextAttribs& txt_attribs, const GfxAttribs& g_attribs,
+                const TextAttribs& txt_attribs, const GfxAttribs* g_attribs,
                 const TextMetrics& txt_metrics,
                 intmax_t char_glyph_idx, intmax_t clip_id) :
-            PdfBoxedItem(bbox, text_ctm),
-            attribs(txt_attribs, g_attribs, clip_id), metrics(txt_metrics),
-            glyph_idx(char_glyph_idx)
-        { unicode = unicode_c; }
-
-        const std::wstring& wstr() const { return unicode; }
-        bool is_space() const { return std::iswspace(unicode[0]); }
+            bbox(x, y, width, height), ctm(text_ctm),
+            txt(txt_attribs), gfx(g_attribs), metrics(txt_metrics),
+            x1(x), y1(y), w(width), h(height),
+            unicode(static_cast<wchar_t>(unicode_c)),
+            glyph_idx(char_glyph_idx), clip_path_id(clip_id)
+        { }
 
-        // checks if this character is "adjacent" to another. That is,
-        // this->spans(previous_char)?
-        bool spans(const PdfChar& pre) const;
+        const BoundingBox& bounding_box() const { return bbox; }
+        bool is_space() const { return std::iswspace(unicode); }
         intmax_t get_glyph_index() const { return glyph_idx; }
 
         double width() const { return bbox.width(); }
@@ -105,54 +109,42 @@ namespace pdftoedn
         double top() const;
         double bottom() const;
 
-        // attributes common to both PdfChar and PdfText
-        struct Attribs
-        {
-            TextAttribs txt;
-            GfxAttribs gfx;
-            intmax_t clip_path_id;
-
-            Attribs() : clip_path_id(-1) {}
-            Attribs(const TextAttribs& ta, const GfxAttribs& ga, intmax_t cp_id) :
-                txt(ta), gfx(ga), clip_path_id(cp_id)
-            {}
-
-            bool operator!=(const Attribs& a2) const {
-                return ( (txt != a2.txt) ||
-                         (gfx.fill != a2.gfx.fill) ||
-                         (clip_path_id != a2.clip_path_id) );
-            }
-        };
-
     private:
-        Attribs attribs;
-        TextMetrics metrics;
-        std::wstring unicode;
+        BoundingBox bbox;
+        const PdfTM& ctm;
+        const TextAttribs& txt;
+        const GfxAttribs* gfx; // interned
+        const TextMetrics& metrics;
+        // position & size as passed in; the span rebuilds the bbox
+        // from these
+        double x1, y1, w, h;
+        wchar_t unicode;
         intmax_t glyph_idx;
+        intmax_t clip_path_id;
 
         friend class PdfText;
-
-        virtual std::ostream& to_edn(std::ostream& o) const { return o; }
     };
 
 
     // -------------------------------------------------------
-    // pdf text sequence. Collects characters in a list and computes
-    // bounding box with call to finalize() (done when the span is
-    // ready to be inserted)
+    // pdf text sequence. Collects characters in a struct-of-arrays
+    // buffer and computes bounding box with call to finalize() (done
+    // when the span is ready to be inserted). Attributes must match
+    // for all characters in a span so they are stored once
     //
     class PdfText : public PdfBoxedItem {
     public:
 
         PdfText() : overlap_pred(nullptr) { }
         PdfText(const PdfTM& ctm) : PdfBoxedItem(ctm), overlap_pred(nullptr) { }
-        virtual ~PdfText() { util::delete_ptr_container_elems(chars); delete overlap_pred; }
+        virtual ~PdfText() { delete overlap_pred; }
 
         // accessors, setters
         uintmax_t length() const { return chars.size(); }
         double font_size() const { return attribs.txt.font_size; }
-        bool spans(const PdfChar& c) const { return c.spans( *(chars.back()) ); }
-        bool push_back(PdfChar* c);
+        double baseline_threshold() const { return attribs.txt.baseline_threshold; }
+        bool spans(const PdfChar& c) const; // is c adjacent to the last char?
+        bool push_back(const PdfChar& c);
         void whiteout(const BoundingBox& wo_region); // remove characters from the span covered by the region
         void finalize();
         intmax_t clip_id() const { return attribs.clip_path_id; }
@@ -181,9 +173,41 @@ namespace pdftoedn
         static const pdftoedn::Symbol SYMBOL_ORIGIN;
         static const pdftoedn::Symbol SYMBOL_GLYPH_IDX;
 
+        // attributes common to all characters in the span
+        struct Attribs
+        {
+            TextAttribs txt;
+            const GfxAttribs* gfx; // interned
+            intmax_t clip_path_id;
+
+            Attribs() : gfx(nullptr), clip_path_id(-1) {}
+        };
+
     private:
-        PdfChar::Attribs attribs;
-        mutable std::list<PdfChar *> chars;
+        // per-character data, one entry per char in each array
+        struct CharBuffer
+        {
+            std::wstring unicode;
+            std::vector<double> x1;
+            std::vector<double> y1;
+            std::vector<double> w;
+            std::vector<double> h;
+            std::vector<intmax_t> glyph_idx;
+
+            uintmax_t size() const { return unicode.size(); }
+            bool empty() const { return unicode.empty(); }
+            bool is_space(uintmax_t i) const { return std::iswspace(unicode[i]); }
+            BoundingBox bounding_box(uintmax_t i) const { return BoundingBox(x1[i], y1[i], w[i], h[i]); }
+
+            void push_back(const PdfChar& c);
+            void pop_back();
+            void move(uintmax_t from, uintmax_t to);
+            void resize(uintmax_t n);
+        };
+
+        Attribs attribs;
+        CharBuffer chars;
+        PdfTM last_ctm; // CTM of the last char pushed, for spans()
         // used for checking text overlaps
         mutable OverlapPred *overlap_pred;
 
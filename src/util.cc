@@ -19,6 +19,8 @@
 #include <sstream>
 #include <string>
 #include <iterator>
+#include <algorithm>
+#include <cstdint>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -37,6 +39,7 @@
 
 #include "graphics.h"
 #include "pdf_links.h"
+#include "pdf_stats_tracker.h"
 #include "util.h"
 
 
@@ -46,17 +49,56 @@ namespace pdftoedn
     namespace util
     {
         // -------------------------------------------------------------------------------
-        // to UTF, etc.
-        std::string md5(const std::string& blob)
+        // md5
+        //
+        // ran into problems with openssl lib & headers across Ubuntu
+        // and OS X so using local code if openssl is not easily found
+#ifdef HAVE_LIBOPENSSL
+        struct MD5Hash::Context {
+            MD5_CTX md5;
+        };
+#else
+        struct MD5Hash::Context {
+            bzflag::MD5 md5;
+        };
+#endif
+
+        MD5Hash::MD5Hash() :
+            ctx(new Context)
         {
-            // ran into problems with openssl lib & headers across
-            // Ubuntu and OS X so using local code if openssl is not
-            // easily found
 #ifdef HAVE_LIBOPENSSL
-            // use openssl to compute
-            uint8_t md5_result[MD5_DIGEST_LENGTH];
+            MD5_Init(&ctx->md5);
+#endif
+        }
 
-            MD5(reinterpret_cast<const unsigned char*>(blob.c_str()), blob.length(), md5_result);
+        MD5Hash::~MD5Hash()
+        {
+            delete ctx;
+        }
+
+        void MD5Hash::update(const void* data, std::size_t length)
+        {
+            StatsTracker::Timer t(StatsTracker::PHASE_MD5);
+
+#ifdef HAVE_LIBOPENSSL
+            MD5_Update(&ctx->md5, data, length);
+#else
+            // bzflag takes 32-bit lengths
+            const char* p = reinterpret_cast<const char*>(data);
+            while (length > 0) {
+                uint32_t chunk = static_cast<uint32_t>(std::min<std::size_t>(length, UINT32_MAX));
+                ctx->md5.update(p, chunk);
+                p += chunk;
+                length -= chunk;
+            }
+#endif
+        }
+
+        std::string MD5Hash::hexdigest()
+        {
+#ifdef HAVE_LIBOPENSSL
+            uint8_t md5_result[MD5_DIGEST_LENGTH];
+            MD5_Final(md5_result, &ctx->md5);
 
             std::stringstream md5_str;
             for (uintmax_t i = 0; i < MD5_DIGEST_LENGTH; i++)
@@ -64,24 +106,46 @@ namespace pdftoedn
 
             return md5_str.str();
 #else
-            return bzflag::md5(blob);
+            return ctx->md5.finalize().hexdigest();
 #endif
         }
 
+        std::string md5(const std::string& blob)
+        {
+            MD5Hash hash;
+            hash.update(blob.data(), blob.length());
+            return hash.hexdigest();
+        }
+
         // -------------------------------------------------------------------------------
         // to UTF, etc.
         std::string string_to_utf(const std::string& str)
         {
-            return boost::locale::conv::utf_to_utf<char>(str);
+            // most strings we see are plain ASCII - nothing to
+            // validate in that case
+            for (char c : str) {
+                if (static_cast<unsigned char>(c) >= 0x80) {
+                    return boost::locale::conv::utf_to_utf<char>(str);
+                }
+            }
+            return str;
         }
         std::string string_to_utf(const std::wstring& str)
         {
-            return boost::locale::conv::utf_to_utf<char>(str);
+            return wstring_to_utfstring(str);
         }
 
+        //
+        // ISO-8859-1 maps byte values directly to code points
         std::wstring string_to_iso8859(const char* str)
         {
-            return boost::locale::conv::to_utf<wchar_t>(str, "ISO-8859-1");
+            std::wstring w_str;
+            if (str) {
+                for (const char* c = str; *c; ++c) {
+                    w_str.push_back( static_cast<unsigned char>(*c) );
+                }
+            }
+            return w_str;
         }
 
         // -------------------------------------------------------------------------------
@@ -89,7 +153,13 @@ namespace pdftoedn
         //
         std::string wstring_to_utfstring(std::wstring const& w_str)
         {
-            return boost::locale::conv::utf_to_utf<char>(w_str);
+            std::string str;
+            str.reserve(w_str.size());
+
+            for (wchar_t c : w_str) {
+                utf8_append(str, static_cast<uint32_t>(c));
+            }
+            return str;
         }
 
         //
@@ -97,12 +167,14 @@ namespace pdftoedn
         std::wstring unicode_to_wstring(const Unicode* const u, int len)
         {
             std::wstring str;
-            wchar_t c[2] = { 0, 0 };
 
-            if (u) {
+            if (u && len > 0) {
+                str.reserve(len);
                 for (int i = 0; i < len; i++) {
-                    c[0] = u[i];
-                    str += c;
+                    // embedded NULs are dropped
+                    if (u[i]) {
+                        str.push_back(u[i]);
+                    }
                 }
             }
 
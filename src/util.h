@@ -67,6 +67,25 @@ namespace pdftoedn {
             for (const E& map_pair : map) { delete map_pair.second; }
         }
 
+        //
+        // incremental md5 so data can be hashed as it is produced
+        class MD5Hash {
+        public:
+            MD5Hash();
+            ~MD5Hash();
+
+            void update(const void* data, std::size_t length);
+            // finalizes the hash - no more updates can be made
+            std::string hexdigest();
+
+        private:
+            struct Context;
+            Context* ctx;
+
+            MD5Hash(const MD5Hash&) = delete;
+            MD5Hash& operator=(const MD5Hash&) = delete;
+        };
+
         //
         // defined in util.cc
         std::string md5(const std::string& blob);
@@ -76,6 +95,32 @@ namespace pdftoedn {
         std::string wstring_to_utfstring(std::wstring const& w_str);
 
         std::wstring unicode_to_wstring(const Unicode* const u, int len);
+
+        //
+        // append the UTF-8 encoding of a code point to a string.
+        // Invalid code points (surrogates or out of range) are
+        // skipped, matching boost::locale's default conversion
+        inline void utf8_append(std::string& out, uint32_t cp) {
+            if (cp < 0x80) {
+                out.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else if (cp < 0x10000) {
+                if (cp >= 0xd800 && cp <= 0xdfff) {
+                    return;
+                }
+                out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else if (cp <= 0x10ffff) {
+                out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+
         uint8_t pdf_to_svg_blend_mode(GfxBlendMode mode);
         void copy_link_meta(PdfLink& link, const LinkDest& ldest, double page_height);
         StreamProps::stream_type_e poppler_stream_type_to_edn(StreamKind k);
@@ -70,7 +70,12 @@ namespace pdftoedn {
                 //               double-nested array and each command
                 //               is now contained in a vector instead
                 //               of a hash
-                return 0x40320;
+                // 0005 0370:  unreleased, v0.37.0
+                //             - images carry a :codec entry with the
+                //               format their file is in and, when
+                //               passed through, an :orientation entry
+                //               with the rotation and flips to apply
+                return 0x50370;
             }
         } // version
     } // util
@@ -173,14 +173,14 @@ namespace pdftoedn
 
             //
             // debug - dump to disk using a unique name
-            void save_blob_to_disk(const std::ostringstream& blob, const std::string& name_pfx, int id)
+            void save_blob_to_disk(const std::string& blob, const std::string& name_pfx, int id)
             {
                 // writes the files to disk
                 std::ostringstream name;
                 name << util::expand_environment_variables("${HOME}") << "/Desktop/"
                      << name_pfx << "-" << id << ".png";
 
-                util::fs::write_image_to_disk(name.str(), blob.str());
+                util::fs::write_image_to_disk(name.str(), blob);
             }
 
 
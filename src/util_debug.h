@@ -35,7 +35,7 @@ namespace pdftoedn
             const char* get_font_type_str(FontSource::FontType type);
             const char* get_font_type_str(GfxFontType type);
             const char* get_blend_mode_str(GfxBlendMode mode);
-            void save_blob_to_disk(const std::ostringstream& blob, const std::string& name_pfx, int id);
+            void save_blob_to_disk(const std::string& blob, const std::string& name_pfx, int id);
             const char* get_font_file_extension(GfxFontType type);
         }
 
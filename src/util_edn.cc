@@ -33,12 +33,16 @@ namespace pdftoedn
         namespace edn
         {
             // =============================================
-            // output operator for pairs
+            // container elements - hash pairs are separated by a
+            // space
             //
-            std::ostream& operator<<(std::ostream& o, const std::pair<EDNNode,EDNNode>& p) {
-                // hash pairs are separated by a space
-                o << p.first << " " << p.second;
-                return o;
+            static void write_elem(util::output::Writer& w, const EDNNode& n) {
+                n.write(w);
+            }
+            static void write_elem(util::output::Writer& w, const std::pair<EDNNode,EDNNode>& p) {
+                p.first.write(w);
+                w.put(' ');
+                p.second.write(w);
             }
 
             // =============================================
@@ -64,7 +68,7 @@ namespace pdftoedn
                 type(UVAL_OBJ), val(reinterpret_cast<const gemable*>(&v)), owner(false) {
             }
             EDNNode::EDNNode(pdftoedn::Symbol&& v) :
-                type(UVAL_OBJ), val(new pdftoedn::Symbol(v)), owner(true) {
+                type(UVAL_SYMBOL), val(v.name()), owner(false) {
             }
             EDNNode::EDNNode(Vector& v) :
                 type(UVAL_OBJ), val(new Vector(v)), owner(true) {
@@ -94,33 +98,24 @@ namespace pdftoedn
                 }
             }
             std::ostream& EDNNode::to_edn(std::ostream& o) const {
+                util::output::Writer w(o);
+                write(w);
+                return o;
+            }
+            void EDNNode::write(util::output::Writer& w) const {
                 switch (type)
                 {
-                  case UVAL_BOOL:   o << std::boolalpha << val.b;   break;
-                  case UVAL_UINT:   o << std::dec << val.ui;        break;
-                  case UVAL_INT:    o << std::dec << val.i;         break;
-                  case UVAL_DOUBLE: o << std::dec << val.d;         break;
-                  case UVAL_OBJ:    o << *(val.obj);                break;
-                  case UVAL_STRING:
-                      o << '"';
-                      // need to escape double quotes in the string
-                      for (char c : (*val.str)) {
-                          switch (c) {
-                            case 0:
-                            case '"':
-                            case '\\':
-                                o << '\\';
-                                break;
-                          }
-                          o << c;
-                      }
-                      o << '"';
-                      break;
+                  case UVAL_BOOL:   w.boolean(val.b);               break;
+                  case UVAL_UINT:   w.number(val.ui);               break;
+                  case UVAL_INT:    w.number(val.i);                break;
+                  case UVAL_DOUBLE: w.number(val.d);                break;
+                  case UVAL_SYMBOL: w.put(':').write(val.sym);      break;
+                  case UVAL_OBJ:    val.obj->to_edn(w.stream());    break;
+                  case UVAL_STRING: w.string(*val.str);             break;
                   default:
                       assert(0 && "attempt to output UNDEF node");
                       break;
                 }
-                return o;
             }
 
             // =============================================
@@ -129,22 +124,30 @@ namespace pdftoedn
             template <class T>
             std::ostream& Container<T>::to_edn(std::ostream& o) const
             {
-                o << open_chars();
+                util::output::Writer w(o);
+                write(w);
+                return o;
+            }
+
+            template <class T>
+            void Container<T>::write(util::output::Writer& w) const
+            {
+                w.write(open_chars());
                 if (elems) {
                     if (elems->size() > 1) {
                         // output each node with a space in between up
                         // to the penultimate one
                         std::for_each( elems->begin(), elems->end() - 1,
                                        [&](const T& n) {
-                                           o << n << sep_chars();
+                                           write_elem(w, n);
+                                           w.write(sep_chars());
                                        });
                     }
                     if (!elems->empty()) {
-                        o << elems->back();
+                        write_elem(w, elems->back());
                     }
                 }
-                o << close_chars();
-                return o;
+                w.write(close_chars());
             }
 
             // =============================================
@@ -42,6 +42,7 @@
 #endif
 
 #include "base_types.h"
+#include "util_output.h"
 
 
 namespace pdftoedn {
@@ -109,6 +110,7 @@ namespace pdftoedn {
                     elems->reserve(size + elems->capacity());
                 }
                 virtual std::ostream& to_edn(std::ostream& o) const;
+                void write(util::output::Writer& w) const;
 
                 friend void swap(Container<T>& c1, Container<T>& c2) {
                     using std::swap;
@@ -179,7 +181,7 @@ namespace pdftoedn {
             {
             public:
 
-                enum Type { UVAL_BOOL, UVAL_UINT, UVAL_INT, UVAL_DOUBLE, UVAL_STRING, UVAL_OBJ };
+                enum Type { UVAL_BOOL, UVAL_UINT, UVAL_INT, UVAL_DOUBLE, UVAL_STRING, UVAL_SYMBOL, UVAL_OBJ };
 
                 // copy & move constructors + op= transfer
                 // ownership. n becomes invalid
@@ -209,8 +211,9 @@ namespace pdftoedn {
                 EDNNode(const std::string& v) : type(UVAL_STRING), val(&v), owner(false) {}
                 EDNNode(std::string&& v)      : type(UVAL_STRING), val(new std::string(v)), owner(true) {}
                 // Coord, BoundingBox, Symbols can be passed as either
-                // an lval or an rval. If the latter, a copy is
-                // made. Bounds so far are only used as lvalues
+                // an lval or an rval. If the latter, a copy is made
+                // except for Symbols which only store their (static)
+                // name. Bounds so far are only used as lvalues
                 EDNNode(const pdftoedn::Coord& c);
                 EDNNode(pdftoedn::Coord&& c);
                 EDNNode(const pdftoedn::BoundingBox& b);
@@ -229,6 +232,7 @@ namespace pdftoedn {
                 { }
 
                 std::ostream& to_edn(std::ostream& o) const;
+                void write(util::output::Writer& w) const;
                 friend std::ostream& operator<<(std::ostream& o, const EDNNode& n) {
                     n.to_edn(o);
                     return o;
@@ -244,6 +248,7 @@ namespace pdftoedn {
                     Val(int val)                      : i(val)   {}
                     Val(double val)                   : d(val)   {}
                     Val(const std::string* val)       : str(val) {}
+                    Val(const char* val)              : sym(val) {}
                     Val(const pdftoedn::gemable* val) : obj(val) {}
 
                     bool b;
@@ -251,6 +256,7 @@ namespace pdftoedn {
                     intmax_t i;
                     double d;
                     const std::string* str;
+                    const char* sym;
                     const pdftoedn::gemable* obj;
                 } val;
                 mutable bool owner;
@@ -19,14 +19,27 @@
 #include <iostream>
 #include <sstream>
 #include <ostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 
 #include <png.h>
 #include <zlib.h>
 #include <poppler/GfxState.h>
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_LIBWEBP
+#include <webp/encode.h>
+#endif
+
 #include "image.h"
 #include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
 #include "util_encode.h"
+#include "util_fs.h"
 #include "runtime_options.h"
 
 namespace pdftoedn
@@ -58,13 +71,13 @@ namespace pdftoedn
             }
 
             //
-            // write / flush methods to write to an ostream
+            // write / flush methods to write to an ImageBuffer
             static void user_io_write(png_structp png_ptr, png_bytep data, png_size_t length)
             {
-                std::ostream* str_p = reinterpret_cast<std::ostream*>( png_get_io_ptr(png_ptr) );
+                ImageBuffer* buf_p = reinterpret_cast<ImageBuffer*>( png_get_io_ptr(png_ptr) );
 
-                if (!str_p) {
-                    png_error(nullptr, "null stream pointer passed to PNG write()");
+                if (!buf_p) {
+                    png_error(nullptr, "null buffer pointer passed to PNG write()");
                     return;
                 }
 
@@ -73,68 +86,349 @@ namespace pdftoedn
                     return;
                 }
 
-                str_p->write((const char*) data, length);
+                buf_p->write(data, length);
             }
 
             static void user_io_flush(png_structp png_ptr)
             {
-                std::ostream* str_p = reinterpret_cast<std::ostream*>( png_get_io_ptr(png_ptr) );
+                // nothing to flush - the buffer is in memory
+            }
 
-                if (!str_p) {
-                    png_error(nullptr, "null stream pointer passed to PNG io_flush()");
-                    return;
+
+            //
+            // poppler to libpng translators
+            static PixelData::format_type poppler_cspace_mode_to_format(uint8_t num_pix_comps, GfxColorSpaceMode cspace_mode)
+            {
+                if (num_pix_comps == 1) {
+                    return PixelData::FORMAT_PALETTE;
+                }
+
+                switch (cspace_mode)
+                {
+                  case csIndexed:
+                  case csSeparation:
+                      return PixelData::FORMAT_PALETTE;
+
+                  case csDeviceGray:
+                  case csCalGray:
+                      return PixelData::FORMAT_GRAY;
+
+                  case csDeviceCMYK:
+                  case csDeviceRGB:
+                  case csCalRGB:
+                  case csLab:
+                  case csICCBased:
+                  case csPattern:
+                  case csDeviceN:
+                  default:
+                      return PixelData::FORMAT_RGB;
                 }
+            }
 
-                str_p->flush();
+            static int format_to_png_type(PixelData::format_type format)
+            {
+                switch (format)
+                {
+                  case PixelData::FORMAT_PALETTE:    return PNG_COLOR_TYPE_PALETTE;
+                  case PixelData::FORMAT_GRAY:       return PNG_COLOR_TYPE_GRAY;
+                  case PixelData::FORMAT_GRAY_ALPHA: return PNG_COLOR_TYPE_GRAY_ALPHA;
+                  case PixelData::FORMAT_RGB_ALPHA:  return PNG_COLOR_TYPE_RGB_ALPHA;
+                  case PixelData::FORMAT_RGB:
+                  default:
+                      return PNG_COLOR_TYPE_RGB;
+                }
             }
 
 
+            // -------------------------------------------------------------------------------
+            // pixel rows
             //
-            // poppler to libpng translators
-            static int poppler_cspace_mode_to_png_type(uint8_t num_pix_comps, GfxColorSpaceMode cspace_mode)
+            void PixelData::resize(format_type fmt, uint32_t w, uint32_t h, uint8_t bpp)
             {
-                int png_color_type;
+                format = fmt;
+                width = w;
+                height = h;
+                bit_depth = bpp;
+                rows.assign(row_size() * height);
+            }
 
-                if (num_pix_comps == 1) {
-                    png_color_type = PNG_COLOR_TYPE_PALETTE;
+            //
+            // rows are kept in memory unless they exceed the limit
+            void RowBuffer::assign(std::size_t length)
+            {
+                release();
+
+                uintmax_t limit = options.image_memory_limit();
+                if (limit > 0 && length > limit) {
+                    char* p;
+                    if (util::fs::map_scratch_file(options.scratch_dir(), length, &p)) {
+                        mapping = reinterpret_cast<uint8_t*>(p);
+                        mapped_length = length;
+                        return;
+                    }
+                    et.log_warn( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE,
+                                 "unable to allocate a temporary file for image rows; keeping them in memory" );
+                }
+                mem.assign(length, 0);
+            }
+
+            void RowBuffer::release()
+            {
+                if (mapping) {
+                    util::fs::unmap_file(reinterpret_cast<char*>(mapping), mapped_length);
+                    mapping = nullptr;
+                    mapped_length = 0;
                 }
-                else
+                std::vector<uint8_t>().swap(mem);
+            }
+
+            void RowBuffer::swap(RowBuffer& other)
+            {
+                std::swap(mem, other.mem);
+                std::swap(mapping, other.mapping);
+                std::swap(mapped_length, other.mapped_length);
+            }
+
+            //
+            // libpng packs pixels so rows carry a byte per sample (two
+            // for 16-bit samples)
+            std::size_t PixelData::row_size() const
+            {
+                std::size_t samples;
+                switch (format)
                 {
-                    switch (cspace_mode)
-                    {
-                      case csIndexed:
-                      case csSeparation:
-                          png_color_type = PNG_COLOR_TYPE_PALETTE;
-                          break;
+                  case FORMAT_GRAY_ALPHA: samples = 2; break;
+                  case FORMAT_RGB:        samples = 3; break;
+                  case FORMAT_RGB_ALPHA:  samples = 4; break;
+                  default:                samples = 1; break;
+                }
+                return samples * width * (bit_depth > 8 ? 2 : 1);
+            }
 
-                      case csDeviceGray:
-                      case csCalGray:
-                          png_color_type = PNG_COLOR_TYPE_GRAY;
-                          break;
 
-                      case csDeviceCMYK:
-                      case csDeviceRGB:
-                      case csCalRGB:
-                      case csLab:
-                      case csICCBased:
-                      case csPattern:
-                      case csDeviceN:
-                      default:
-                          png_color_type = PNG_COLOR_TYPE_RGB;
-                          break;
+            //
+            // each destination pixel is the average of the source
+            // pixels it covers. Palette indices can't be averaged so
+            // the first pixel covered is used instead
+            void downsample(PixelData& pixels, uint32_t width, uint32_t height)
+            {
+                if (pixels.width == 0 || pixels.height == 0 ||
+                    width == 0 || height == 0 ||
+                    (width >= pixels.width && height >= pixels.height)) {
+                    return;
+                }
+                width = std::min(width, pixels.width);
+                height = std::min(height, pixels.height);
+
+                PixelData scaled;
+                scaled.resize(pixels.format, width, height, pixels.bit_depth);
+                scaled.bottom_up = pixels.bottom_up;
+                scaled.palette.swap(pixels.palette);
+                scaled.transparency.swap(pixels.transparency);
+
+                std::size_t sample_size = (pixels.bit_depth > 8 ? 2 : 1);
+                std::size_t samples = pixels.row_size() / sample_size / pixels.width;
+                bool average = (pixels.format != PixelData::FORMAT_PALETTE);
+
+                // source column ranges covered by each destination column
+                std::vector<uint32_t> col(width + 1);
+                for (uint32_t x = 0; x <= width; x++) {
+                    col[x] = static_cast<uint32_t>((static_cast<uint64_t>(x) * pixels.width) / width);
+                }
+
+                std::vector<uint64_t> sums(width * samples);
+                for (uint32_t y = 0; y < height; y++) {
+                    uint32_t y0 = static_cast<uint32_t>((static_cast<uint64_t>(y) * pixels.height) / height);
+                    uint32_t y1 = static_cast<uint32_t>((static_cast<uint64_t>(y + 1) * pixels.height) / height);
+                    uint8_t* dst = scaled.row(y);
+
+                    if (!average) {
+                        const uint8_t* src = pixels.row(y0);
+                        for (uint32_t x = 0; x < width; x++) {
+                            std::memcpy(dst + x * samples, src + col[x] * samples, samples);
+                        }
+                        continue;
+                    }
+
+                    std::fill(sums.begin(), sums.end(), 0);
+                    for (uint32_t sy = y0; sy < y1; sy++) {
+                        const uint8_t* src = pixels.row(sy);
+                        uint64_t* sum = sums.data();
+
+                        for (uint32_t x = 0; x < width; x++, sum += samples) {
+                            for (uint32_t sx = col[x]; sx < col[x + 1]; sx++) {
+                                const uint8_t* s = src + sx * samples * sample_size;
+                                for (std::size_t i = 0; i < samples; i++) {
+                                    // 16-bit samples are big-endian
+                                    sum[i] += ((sample_size == 2) ?
+                                               ((s[2 * i] << 8) | s[2 * i + 1]) : s[i]);
+                                }
+                            }
+                        }
+                    }
+
+                    const uint64_t* sum = sums.data();
+                    for (uint32_t x = 0; x < width; x++, sum += samples) {
+                        uint64_t area = static_cast<uint64_t>(col[x + 1] - col[x]) * (y1 - y0);
+                        for (std::size_t i = 0; i < samples; i++) {
+                            uint64_t v = (sum[i] + area / 2) / area;
+                            if (sample_size == 2) {
+                                dst[2 * (x * samples + i)]     = static_cast<uint8_t>(v >> 8);
+                                dst[2 * (x * samples + i) + 1] = static_cast<uint8_t>(v);
+                            } else {
+                                dst[x * samples + i] = static_cast<uint8_t>(v);
+                            }
+                        }
+                    }
+                }
+
+                std::swap(pixels, scaled);
+            }
+
+
+            //
+            // source pixel coordinate as a function of the destination
+            // coordinates: s = s0 + sx * x + sy * y
+            struct PixelMap {
+                int64_t s0, sx, sy;
+            };
+
+            //
+            // copies pixels of N bytes to their oriented positions.
+            // Destination rows are written in tiles so the source
+            // columns read by a 90 / 270 degree rotation stay in cache
+            template <std::size_t N>
+            static void orient_pixels(const PixelData& src, PixelData& dst,
+                                      const PixelMap& col, const PixelMap& row)
+            {
+                static const uint32_t TILE_SIZE = 64;
+
+                const int64_t stride = src.row_size();
+                const int64_t step = row.sx * stride + col.sx * static_cast<int64_t>(N);
+                const uint8_t* base = src.rows.data();
+
+                for (uint32_t ty = 0; ty < dst.height; ty += TILE_SIZE) {
+                    uint32_t y_end = std::min(ty + TILE_SIZE, dst.height);
+
+                    for (uint32_t tx = 0; tx < dst.width; tx += TILE_SIZE) {
+                        uint32_t x_end = std::min(tx + TILE_SIZE, dst.width);
+
+                        for (uint32_t y = ty; y < y_end; y++) {
+                            int64_t sx = col.s0 + col.sx * tx + col.sy * y;
+                            int64_t sy = row.s0 + row.sx * tx + row.sy * y;
+                            const uint8_t* s = base + sy * stride + sx * static_cast<int64_t>(N);
+                            uint8_t* d = dst.row(y) + tx * N;
+
+                            for (uint32_t x = tx; x < x_end; x++, s += step, d += N) {
+                                std::memcpy(d, s, N);
+                            }
+                        }
                     }
                 }
+            }
+
+            //
+            // vertical flips only reverse the order rows are encoded
+            // in; anything else is copied to a new buffer
+            void orient(PixelData& pixels, int rotation, bool flip_h, bool flip_v)
+            {
+                if (pixels.width == 0 || pixels.height == 0) {
+                    return;
+                }
+
+                if (rotation == 0 && !flip_h) {
+                    pixels.bottom_up = (pixels.bottom_up != flip_v);
+                    return;
+                }
+
+                bool swap_axes = (rotation == 90 || rotation == 270);
+                int64_t w = pixels.width, h = pixels.height;
+
+                PixelData oriented;
+                oriented.resize(pixels.format,
+                                (swap_axes ? pixels.height : pixels.width),
+                                (swap_axes ? pixels.width : pixels.height),
+                                pixels.bit_depth);
+                oriented.palette.swap(pixels.palette);
+                oriented.transparency.swap(pixels.transparency);
+
+                // flips apply to the rotated image: f = f0 + fs * x
+                int64_t fx0 = (flip_h ? oriented.width - 1 : 0), fxs = (flip_h ? -1 : 1);
+                int64_t fy0 = (flip_v ? oriented.height - 1 : 0), fys = (flip_v ? -1 : 1);
+
+                PixelMap col, row;
+                switch (rotation)
+                {
+                  case 90:
+                      col = { fy0, 0, fys };
+                      row = { h - 1 - fx0, -fxs, 0 };
+                      break;
+                  case 180:
+                      col = { w - 1 - fx0, -fxs, 0 };
+                      row = { h - 1 - fy0, 0, -fys };
+                      break;
+                  case 270:
+                      col = { w - 1 - fy0, 0, -fys };
+                      row = { fx0, fxs, 0 };
+                      break;
+                  default:
+                      col = { fx0, fxs, 0 };
+                      row = { fy0, 0, fys };
+                      break;
+                }
+
+                // the source rows may already be stored bottom up
+                if (pixels.bottom_up) {
+                    row = { h - 1 - row.s0, -row.sx, -row.sy };
+                }
+
+                switch (pixels.row_size() / pixels.width)
+                {
+                  case 1: orient_pixels<1>(pixels, oriented, col, row); break;
+                  case 2: orient_pixels<2>(pixels, oriented, col, row); break;
+                  case 3: orient_pixels<3>(pixels, oriented, col, row); break;
+                  case 4: orient_pixels<4>(pixels, oriented, col, row); break;
+                  case 6: orient_pixels<6>(pixels, oriented, col, row); break;
+                  case 8: orient_pixels<8>(pixels, oriented, col, row); break;
+                }
+
+                std::swap(pixels, oriented);
+            }
+
+
+            //
+            // next line of unpacked pixel components (one byte each)
+            // from the image stream
+            static inline unsigned char* get_image_line(ImageStream* img_str)
+            {
+                unsigned char* line = img_str->getLine();
+                if (!line) {
+                    std::stringstream err;
+                    err << __FUNCTION__ << "() - image stream ended before all rows were read";
+                    throw std::runtime_error(err.str());
+                }
+                return line;
+            }
 
-                return png_color_type;
+            //
+            // copies a line into a row. Lines don't always match the
+            // PNG row size so only what fits is copied and the rest
+            // is left zeroed
+            static inline void copy_line(uint8_t* row, std::size_t row_size,
+                                         const unsigned char* line, std::size_t line_size)
+            {
+                std::memcpy(row, line, std::min(row_size, line_size));
             }
 
 
             //
             // copy pixmap data
-            static void copy_image_data(png_structp png_ptr,
-                                        ImageStream* img_str, uint32_t width, uint32_t height,
+            static void copy_image_data(PixelData& pixels, ImageStream* img_str,
                                         uint8_t num_pix_comps, GfxColorSpaceMode cspace_mode, GfxColorSpace* cspace)
             {
+                uint32_t width = pixels.width;
+                std::size_t row_size = pixels.row_size();
+
                 // read the image bytes
                 img_str->reset();
 
@@ -142,103 +436,59 @@ namespace pdftoedn
                 {
                   case csIndexed:
                   case csSeparation:
-                      for (size_t y = 0; y < height; y++) {
-                          unsigned char *pix = img_str->getLine();
-                          png_write_rows(png_ptr, &pix, 1);
+                  case csDeviceGray:
+                  case csCalGray:
+                  case csDeviceRGB:
+                  case csCalRGB:
+                      // palette indices or gray / RGB components are
+                      // copied as is
+                      for (size_t y = 0; y < pixels.height; y++) {
+                          copy_line(pixels.row(y), row_size, get_image_line(img_str), width * num_pix_comps);
                       }
                       break;
 
                   case csDeviceCMYK:
+                  case csICCBased:
                       {
-                          GfxDeviceCMYKColorSpace* cmyk_cs = dynamic_cast<GfxDeviceCMYKColorSpace*>(cspace);
-
-                          if (!cmyk_cs) {
-                              std::stringstream err;
-                              err << __FUNCTION__ << "() - poppler "
-                                  << GfxColorSpace::getColorSpaceModeName(cspace_mode)
-                                  << " stream not carrying CMYK color space";
-                              throw std::runtime_error(err.str());
-                          }
-
-                          // we'll convert cmyk to RGB so only need 3 color chans
-                          png_bytep data_row = reinterpret_cast<png_bytep>( png_malloc(png_ptr, 3 * sizeof(png_byte) * width) );
-                          if (!data_row) {
-                              std::stringstream err;
-                              err << __FUNCTION__ << "() - png_malloc failed when handling color space "
-                                  << GfxColorSpace::getColorSpaceModeName(cspace_mode);
-                              throw std::runtime_error(err.str());
-                          }
+                          // we'll convert it to RGB so only need 3 color chans
+                          GfxDeviceCMYKColorSpace* cmyk_cs = nullptr;
+                          GfxICCBasedColorSpace* icc_cs = nullptr;
 
-                          for (size_t y = 0; y < height; ++y)
-                          {
-                              cmyk_cs->getRGBLine(img_str->getLine(), data_row, width);
-                              png_write_rows(png_ptr, &data_row, 1);
+                          if (cspace_mode == csDeviceCMYK) {
+                              cmyk_cs = dynamic_cast<GfxDeviceCMYKColorSpace*>(cspace);
+                          } else {
+                              icc_cs = dynamic_cast<GfxICCBasedColorSpace*>(cspace);
                           }
 
-                          png_free(png_ptr, data_row);
-                      }
-                      break;
-
-                  case csICCBased:
-                      {
-                          GfxICCBasedColorSpace* icc_cs = dynamic_cast<GfxICCBasedColorSpace*>(cspace);
-
-                          if (!icc_cs) {
+                          if (!cmyk_cs && !icc_cs) {
                               std::stringstream err;
                               err << __FUNCTION__ << "() - poppler "
                                   << GfxColorSpace::getColorSpaceModeName(cspace_mode)
-                                  << " stream not carrying ICC based color space";
+                                  << " stream not carrying "
+                                  << (cspace_mode == csDeviceCMYK ? "CMYK" : "ICC based")
+                                  << " color space";
                               throw std::runtime_error(err.str());
                           }
 
-                          // we'll convert it to RGB so only need 3 color chans
-                          png_bytep data_row = reinterpret_cast<png_bytep>( png_malloc(png_ptr, 3 * sizeof(png_byte) * width) );
-                          if (!data_row) {
-                              std::stringstream err;
-                              err << __FUNCTION__ << "() - png_malloc failed when handling color space "
-                                  << GfxColorSpace::getColorSpaceModeName(cspace_mode);
-                              throw std::runtime_error(err.str());
-                          }
+                          // RGB lines are converted straight into the
+                          // rows unless these are narrower (1-component
+                          // ICC streams)
+                          std::vector<uint8_t> rgb_line(row_size < 3 * width ? 3 * width : 0);
 
-                          for (size_t y = 0; y < height; ++y)
+                          for (size_t y = 0; y < pixels.height; ++y)
                           {
-                              icc_cs->getRGBLine(img_str->getLine(), data_row, width);
-                              png_write_rows(png_ptr, &data_row, 1);
-                          }
-
-                          png_free(png_ptr, data_row);
-                      }
-                      break;
-
-                  case csDeviceGray:
-                  case csCalGray:
-                  case csDeviceRGB:
-                  case csCalRGB:
-                      {
-                          unsigned char pix[num_pix_comps];
+                              uint8_t* dest = (rgb_line.empty() ? pixels.row(y) : rgb_line.data());
 
-                          png_bytep data_row = reinterpret_cast<png_bytep>( png_malloc(png_ptr, num_pix_comps * sizeof(png_byte) * width) );
-                          if (!data_row) {
-                              std::stringstream err;
-                              err << __FUNCTION__ << "() - png_malloc failed for color space "
-                                  << GfxColorSpace::getColorSpaceModeName(cspace_mode);
-                              throw std::runtime_error(err.str());
-                          }
+                              if (cmyk_cs) {
+                                  cmyk_cs->getRGBLine(get_image_line(img_str), dest, width);
+                              } else {
+                                  icc_cs->getRGBLine(get_image_line(img_str), dest, width);
+                              }
 
-                          for (size_t y = 0; y < height; ++y)
-                          {
-                              for (size_t x = 0; x < width * num_pix_comps;)
-                              {
-                                  if (img_str->getPixel(pix)) {
-                                      for (int z = 0; z < num_pix_comps; z++) {
-                                          data_row[x++] = pix[z];
-                                      }
-                                  }
+                              if (!rgb_line.empty()) {
+                                  copy_line(pixels.row(y), row_size, rgb_line.data(), rgb_line.size());
                               }
-                              png_write_rows(png_ptr, &data_row, 1);
                           }
-
-                          png_free(png_ptr, data_row);
                       }
                       break;
 
@@ -256,48 +506,19 @@ namespace pdftoedn
 
 
             //
-            // export the data as a PNG onto an ostream - based on:
-            //
-            //  http://www.linbox.com/ucome.rvt?file=/any/doc_distrib/libgr-2.0.13/png/example.c
-            bool encode_image(std::ostream& output, ImageStream* img_str,
-                              const StreamProps& properties,
-                              GfxImageColorMap *color_map)
+            // read an image, building its palette if it's indexed
+            bool read_image(PixelData& pixels, ImageStream* img_str,
+                            const StreamProps& properties,
+                            GfxImageColorMap *color_map)
             {
-                // Create and initialize the png_struct with the desired error handler
-                // functions.  If you want to use the default stderr and longjump method,
-                // you can supply null for the last three parameters.  We also check that
-                // the library version is compatible with the one used at compile time,
-                // in case we are using dynamically linked libraries.
-                png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                                              nullptr,
-                                                              user_error_fn,
-                                                              user_warning_fn);
-                if (!png_ptr) {
-                    return false;
-                }
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_ENCODE);
 
-                // Allocate/initialize the image information data.
-                png_infop info_ptr = png_create_info_struct(png_ptr);
-                if (!info_ptr) {
-                    png_destroy_write_struct(&png_ptr, nullptr);
-                    return false;
-                }
-
-                // use our write & flush functions
-                png_set_write_fn(png_ptr,
-                                 reinterpret_cast<png_voidp *>(&output),
-                                 user_io_write,
-                                 user_io_flush);
-
-                // prep some things before we make the libpng calls
                 uintmax_t width = properties.bitmap_width();
                 uintmax_t height = properties.bitmap_height();
                 uint8_t bpp = properties.bitmap_bpp();
                 uint8_t num_pix_comps = properties.bitmap_num_pixel_comps();
 
                 GfxColorSpaceMode cspace_mode = color_map->getColorSpace()->getMode();
-                int png_type = poppler_cspace_mode_to_png_type(num_pix_comps, cspace_mode);
-                png_colorp palette = nullptr;
 
 #if 0
                 std::cerr << "color space mode is: '"
@@ -310,37 +531,14 @@ namespace pdftoedn
                 bool status = true;
                 try
                 {
-                    // Set the image information here.  Width and height
-                    // are up to 2^31, bit_depth is one of 1, 2, 4, 8, or
-                    // 16, but valid values also depend on the color_type
-                    // selected. color_type is one of PNG_COLOR_TYPE_GRAY,
-                    // PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE,
-                    // PNG_COLOR_TYPE_RGB, or PNG_COLOR_TYPE_RGB_ALPHA.
-                    // interlace is either PNG_INTERLACE_NONE or
-                    // PNG_INTERLACE_ADAM7, and the compression_type and
-                    // filter_type MUST currently be
-                    // PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE.
-                    //
-                    png_set_IHDR(png_ptr, info_ptr, width, height, bpp,
-                                 png_type,
-                                 PNG_INTERLACE_NONE,
-                                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-                    if (pdftoedn::options.libpng_use_best_compression()) {
-                        png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
-                    }
+                    pixels.resize(poppler_cspace_mode_to_format(num_pix_comps, cspace_mode),
+                                  width, height, bpp);
 
-                    // allocate palette for indexed-color images
-                    if (png_type == PNG_COLOR_TYPE_PALETTE)
+                    // palette for indexed-color images
+                    if (pixels.format == PixelData::FORMAT_PALETTE)
                     {
                         int n = 1 << bpp;
-
-                        palette = reinterpret_cast<png_colorp>( png_malloc(png_ptr, n * sizeof (png_color)) );
-                        if (!palette) {
-                            std::stringstream err;
-                            err << __FUNCTION__ << "() - couldn't alloc storage for image palette";
-                            throw std::runtime_error(err.str());
-                        }
+                        pixels.palette.resize(3 * n);
 
                         unsigned char pix;
                         GfxRGB rgb;
@@ -349,35 +547,15 @@ namespace pdftoedn
                             pix = static_cast<unsigned char>(i);
 
                             color_map->getRGB(&pix, &rgb);
-                            palette[i].red = colToByte(rgb.r);
-                            palette[i].green = colToByte(rgb.g);
-                            palette[i].blue = colToByte(rgb.b);
+                            pixels.palette[3 * i]     = colToByte(rgb.r);
+                            pixels.palette[3 * i + 1] = colToByte(rgb.g);
+                            pixels.palette[3 * i + 2] = colToByte(rgb.b);
                         }
-
-                        png_set_PLTE(png_ptr, info_ptr, palette, n);
                     }
 
-                    // Write the file header information.
-                    png_write_info(png_ptr, info_ptr);
-
-                    // pack pixels into bytes
-                    png_set_packing(png_ptr);
-
-                    // swap bits of 1, 2, 4 bit packed pixel formats
-                    png_set_packswap(png_ptr);
-
                     // ready to copy the data - iterate through the lines
-                    img_str->reset();
-                    copy_image_data(png_ptr, img_str, width, height, num_pix_comps,
+                    copy_image_data(pixels, img_str, num_pix_comps,
                                     cspace_mode, color_map->getColorSpace());
-
-                    // finish writing the rest of the file
-                    png_write_end(png_ptr, info_ptr);
-
-                }
-                catch (libpng_error& e) {
-                    et.log_critical( ErrorTracker::ERROR_PNG_ERROR, MODULE, e.what() );
-                    status = false;
                 }
                 catch (std::exception& e) {
                     et.log_critical( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE, e.what() );
@@ -386,40 +564,33 @@ namespace pdftoedn
 
                 // cleanup
                 img_str->close();
-
-                // free the palette if allocated
-                if (palette) {
-                    png_free(png_ptr, palette);
-                }
-
-                // clean up after the write, and free any memory allocated
-                png_destroy_write_struct(&png_ptr, &info_ptr);
                 return status;
             }
 
 
             //
-            // export the data as a PNG RGBA onto an ostream - based on:
-            //
-            //  http://www.linbox.com/ucome.rvt?file=/any/doc_distrib/libgr-2.0.13/png/example.c
-            bool encode_rgba_image(std::ostream& output, ImageStream* img_str, ImageStream* mask_str,
-                                   const StreamProps& properties,
-                                   GfxImageColorMap *color_map, GfxImageColorMap *mask_color_map,
-                                   bool mask_invert)
+            // read an image and its mask, combining the image data
+            // (RGB or Gray) with mask data (1-channel) to form RGBA or
+            // Gray+alpha rows
+            bool read_rgba_image(PixelData& pixels, ImageStream* img_str, ImageStream* mask_str,
+                                 const StreamProps& properties,
+                                 GfxImageColorMap *color_map, GfxImageColorMap *mask_color_map,
+                                 bool mask_invert)
             {
-                // Set the image information here
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_ENCODE);
+
                 GfxColorSpaceMode cspace_mode = color_map->getColorSpace()->getMode();
-                int png_type;
+                PixelData::format_type format;
 
                 switch (cspace_mode) {
                   case csDeviceRGB:
                   case csICCBased:
                   case csIndexed:
                   case csSeparation:
-                      png_type = PNG_COLOR_TYPE_RGB_ALPHA;
+                      format = PixelData::FORMAT_RGB_ALPHA;
                       break;
                   case csDeviceGray:
-                      png_type = PNG_COLOR_TYPE_GRAY_ALPHA;
+                      format = PixelData::FORMAT_GRAY_ALPHA;
                       break;
                   default:
                       std::stringstream err;
@@ -430,167 +601,242 @@ namespace pdftoedn
                       return false;
                 }
 
-                // Create and initialize the png_struct with the desired error handler
-                // functions.
-                png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                                              nullptr,
-                                                              user_error_fn,
-                                                              user_warning_fn);
-                if (!png_ptr) {
-                    return false;
-                }
-
-                // Allocate/initialize the image information data.
-                png_infop info_ptr = png_create_info_struct(png_ptr);
-                if (!info_ptr) {
-                    png_destroy_write_struct(&png_ptr, nullptr);
-                    return false;
-                }
-
-                // use our write & flush functions
-                png_set_write_fn(png_ptr,
-                                 reinterpret_cast<png_voidp *>(&output),
-                                 user_io_write,
-                                 user_io_flush);
-
                 uintmax_t width = properties.bitmap_width();
                 uintmax_t height = properties.bitmap_height();
-                uint8_t num_pix_comps = properties.bitmap_num_pixel_comps();
-                uint8_t bpp = properties.bitmap_bpp();
                 uintmax_t mask_width = properties.mask_width();
                 uintmax_t mask_height = properties.mask_height();
                 uint8_t mask_num_pix_comps = properties.mask_num_pixel_comps();
-                png_colorp palette = nullptr;
-
-                png_bytep data_row = nullptr;
-                uint8_t* mask_buf = nullptr;
                 bool status = true;
 
                 try
                 {
-                    png_set_IHDR(png_ptr, info_ptr, width, height, bpp,
-                                 png_type,
-                                 PNG_INTERLACE_NONE,
-                                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-                    if (pdftoedn::options.libpng_use_best_compression()) {
-                        png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
-                    }
-
-                    // Write the file header information.
-                    png_write_info(png_ptr, info_ptr);
-
-                    // pack pixels into bytes
-                    png_set_packing(png_ptr);
-
-                    // swap bits of 1, 2, 4 bit packed pixel formats
-                    png_set_packswap(png_ptr);
-
-                    // ready to copy image data - combine the image data
-                    // (RGB if 3 bpp, Grey if 1) with mask data
-                    // (1-channel) to form an RGBA png
-                    unsigned char pix[num_pix_comps];
-                    unsigned char* mask_bits;
-                    uint32_t o_num_pix_comps = 4; // add 1 for alpha channel
+                    pixels.resize(format, width, height, properties.bitmap_bpp());
 
-                    data_row = reinterpret_cast<png_bytep>( png_malloc(png_ptr, o_num_pix_comps * sizeof(png_byte) * width) );
-                    if (!data_row) {
-                        std::stringstream err;
-                        err << __FUNCTION__ << "() - couldn't alloc storage for image row buffer";
-                        throw std::runtime_error(err.str());
-                    }
+                    // buffer for the mask line
+                    std::vector<uint8_t> mask_buf(mask_width * mask_num_pix_comps);
 
-                    // allocate a buffer for the mask line
-                    mask_buf = new uint8_t[mask_width * mask_num_pix_comps];
-                    if (!mask_buf) {
-                        std::stringstream err;
-                        err << __FUNCTION__ << "() - couldn't alloc storage for mask buffer";
-                        throw std::runtime_error(err.str());
+                    // the mask is not always the same size as the
+                    // image so map image columns to mask columns
+                    std::vector<uintmax_t> mask_col(width);
+                    for (size_t x = 0; x < width; ++x) {
+                        mask_col[x] = (x * mask_width) / width;
                     }
+                    std::vector<uint8_t> gray_row(format == PixelData::FORMAT_GRAY_ALPHA ? width : 0);
 
                     img_str->reset();
                     mask_str->reset();
 
                     // process image line by line
+                    uintmax_t mask_y = 0;
                     for (size_t y = 0; y < height; ++y)
                     {
-                        mask_bits = mask_str->getLine();
+                        // read mask lines up to the one matching this row
+                        uintmax_t row_mask_y = (y * mask_height) / height;
+                        for (; mask_y <= row_mask_y; ++mask_y) {
+                            unsigned char* mask_bits = get_image_line(mask_str);
 
-                        // poppler returns some masked images w/ a color map
-                        if (mask_color_map) {
-                            mask_color_map->getGrayLine(mask_bits, mask_buf, mask_width);
-                        }
-                        else {
-                            // no cmap - just read the value and invert if needed
-                            for (size_t mx = 0; mx < mask_width; mx++) {
-                                bool bit = (mask_invert ? !mask_bits[mx] : mask_bits[mx]);
-                                mask_buf[mx] = (bit ? 0 : 0xff);
+                            if (mask_y < row_mask_y) {
+                                continue;
                             }
-                        }
 
-                        // now process image data
-                        for (size_t x = 0, mx = 0; x < width * o_num_pix_comps;)
-                        {
-                            if (img_str->getPixel(pix)) {
-                                if (num_pix_comps > 1) {
-                                    GfxRGB rgb;
-                                    color_map->getRGB(pix, &rgb);
-                                    data_row[x++] = colToByte(rgb.r);
-                                    data_row[x++] = colToByte(rgb.g);
-                                    data_row[x++] = colToByte(rgb.b);
-                                } else {
-                                    GfxGray g;
-                                    color_map->getGray(pix, &g);
-                                    uint8_t c = colToByte(g);
-
-                                    data_row[x++] = c;
-                                    data_row[x++] = c;
-                                    data_row[x++] = c;
+                            // poppler returns some masked images w/ a color map
+                            if (mask_color_map) {
+                                mask_color_map->getGrayLine(mask_bits, mask_buf.data(), mask_width);
+                            }
+                            else {
+                                // no cmap - just read the value and invert if needed
+                                for (size_t mx = 0; mx < mask_width; mx++) {
+                                    bool bit = (mask_invert ? !mask_bits[mx] : mask_bits[mx]);
+                                    mask_buf[mx] = (bit ? 0 : 0xff);
                                 }
                             }
+                        }
+
+                        // convert the image row, then interleave the
+                        // alpha values from the mask
+                        unsigned char* pix = get_image_line(img_str);
+                        uint8_t* data_row = pixels.row(y);
 
-                            // and set alpha to the mask value
-                            data_row[x++] = mask_buf[mx++];
+                        if (format == PixelData::FORMAT_GRAY_ALPHA) {
+                            color_map->getGrayLine(pix, gray_row.data(), width);
+                            for (size_t x = 0; x < width; ++x) {
+                                data_row[2 * x]     = gray_row[x];
+                                data_row[2 * x + 1] = mask_buf[mask_col[x]];
+                            }
+                        } else {
+                            // RGBX with X = 0xff
+                            color_map->getRGBXLine(pix, data_row, width);
+                            for (size_t x = 0; x < width; ++x) {
+                                data_row[4 * x + 3] = mask_buf[mask_col[x]];
+                            }
                         }
-                        png_write_rows(png_ptr, &data_row, 1);
                     }
-
-                    png_write_end(png_ptr, info_ptr);
                 }
-                catch (libpng_error& e) {
-                    et.log_critical( ErrorTracker::ERROR_PNG_ERROR, MODULE, e.what() );
+                catch (std::exception& e) {
+                    et.log_critical( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE, e.what() );
                     status = false;
                 }
+
+                // cleanup
+                mask_str->close();
+                img_str->close();
+                return status;
+            }
+
+
+            //
+            // read a mask into a 2-color palette image w/ the
+            // unmasked color set to transparent
+            bool read_mask(PixelData& pixels, ImageStream* img_str, const StreamProps& properties)
+            {
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_ENCODE);
+
+                uintmax_t width = properties.mask_width();
+                uintmax_t height = properties.mask_height();
+                bool status = true;
+
+                try
+                {
+                    pixels.resize(PixelData::FORMAT_PALETTE, width, height, 1);
+
+                    // by default set the 2nd color to white.. leptonica
+                    // does not preserve transparency so this should make
+                    // it match white background at least
+                    const RGBColor& fill = properties.mask_fill_color();
+                    pixels.palette = { static_cast<uint8_t>(fill.red()),
+                                       static_cast<uint8_t>(fill.green()),
+                                       static_cast<uint8_t>(fill.blue()),
+                                       0xff, 0xff, 0xff };
+
+                    // 2-palette entries.. one is set to transparent (0x00)
+                    pixels.transparency = { 0xff, 0x00 };
+
+                    // reset the poppler image stream
+                    img_str->reset();
+
+                    for (size_t y = 0; y < height; y++) {
+                        unsigned char* pix = get_image_line(img_str);
+                        uint8_t* data_row = pixels.row(y);
+                        for (size_t x = 0; x < width; x++) {
+                            data_row[x] = (properties.mask_is_inverted() ? !pix[x] : pix[x]);
+                        }
+                    }
+                }
                 catch (std::exception& e) {
                     et.log_critical( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE, e.what() );
                     status = false;
                 }
 
                 // cleanup
-                mask_str->close();
                 img_str->close();
+                return status;
+            }
 
-                delete [] mask_buf;
-                if (data_row) {
-                    png_free(png_ptr, data_row);
+
+            //
+            // reads the stream below the image's last filter, which
+            // is the image file for DCT (JPEG) and JPX streams
+            bool read_encoded_stream(std::string& data, Stream* str)
+            {
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_ENCODE);
+
+                Stream* encoded_str = str->getNextStream();
+                if (!encoded_str) {
+                    et.log_error( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE,
+                                  "image stream has no encoded data to read" );
+                    return false;
                 }
 
-                // free the palette if allocated
-                if (palette) {
-                    png_free(png_ptr, palette);
+                unsigned char buf[16 * 1024];
+                int len;
+
+                data.clear();
+                encoded_str->reset();
+                while ((len = encoded_str->doGetChars(sizeof(buf), buf)) > 0) {
+                    data.append(reinterpret_cast<const char*>(buf), len);
                 }
+                encoded_str->close();
 
-                // clean up after the write, and free any memory allocated
-                png_destroy_write_struct(&png_ptr, &info_ptr);
-                return status;
+                if (data.empty()) {
+                    et.log_error( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE,
+                                  "image stream is empty" );
+                    return false;
+                }
+                return true;
+            }
+
+
+            //
+            // hashes the data of the stream as it's stored in the
+            // document, before any filters are applied. The stream is
+            // reset when the image is read afterwards
+            bool hash_raw_stream(util::MD5Hash& hash, Stream* str)
+            {
+                Stream* base_str = str->getBaseStream();
+                if (!base_str) {
+                    return false;
+                }
+
+                unsigned char buf[16 * 1024];
+                int len;
+                bool empty = true;
+
+                base_str->reset();
+                while ((len = base_str->doGetChars(sizeof(buf), buf)) > 0) {
+                    hash.update(buf, len);
+                    empty = false;
+                }
+                base_str->close();
+                return !empty;
             }
 
 
             //
-            // export a mask onto a stream as a PNG w/ transparency.
-            // Yeah, lots of replicated steps from encode_image.. :(
-            bool encode_mask(std::ostream& output, ImageStream* img_str, const StreamProps& properties)
+            // hashes the RGB values samples are mapped to so the same
+            // data drawn with a different palette, decode array, etc.
+            // doesn't match. Every value of each component is mapped
+            // with the others set to 0 and to the same value; a
+            // single component (gray, indexed) is mapped exhaustively
+            void hash_color_map(util::MD5Hash& hash, GfxImageColorMap* colorMap)
             {
+                int num_comps = colorMap->getNumPixelComps();
+                int max_value = std::min((1 << colorMap->getBits()) - 1, 255);
+                int32_t header[3] = { colorMap->getColorSpace()->getMode(), num_comps, colorMap->getBits() };
+                hash.update(header, sizeof(header));
+
+                unsigned char pix[gfxColorMaxComps];
+                GfxRGB rgb;
+                for (int c = 0; c < num_comps; c++) {
+                    for (int v = 0; v <= max_value; v++) {
+                        std::fill(pix, pix + num_comps, 0);
+                        pix[c] = v;
+                        colorMap->getRGB(pix, &rgb);
+                        hash.update(&rgb, sizeof(rgb));
+
+                        if (num_comps > 1) {
+                            std::fill(pix, pix + num_comps, v);
+                            colorMap->getRGB(pix, &rgb);
+                            hash.update(&rgb, sizeof(rgb));
+                        }
+                    }
+                }
+            }
+
+
+            //
+            // export the rows as a PNG into a buffer - based on:
+            //
+            //  http://www.linbox.com/ucome.rvt?file=/any/doc_distrib/libgr-2.0.13/png/example.c
+            //
+            // Only libpng is used here so this can be run outside of
+            // the thread interpreting the document
+            static bool encode_png(ImageBuffer& output, const PixelData& pixels, const ImageCodec& codec)
+            {
+                // Create and initialize the png_struct with the desired error handler
+                // functions.  If you want to use the default stderr and longjump method,
+                // you can supply null for the last three parameters.  We also check that
+                // the library version is compatible with the one used at compile time,
+                // in case we are using dynamically linked libraries.
                 png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                               nullptr,
                                                               user_error_fn,
@@ -599,85 +845,91 @@ namespace pdftoedn
                     return false;
                 }
 
+                // Allocate/initialize the image information data.
                 png_infop info_ptr = png_create_info_struct(png_ptr);
                 if (!info_ptr) {
                     png_destroy_write_struct(&png_ptr, nullptr);
                     return false;
                 }
 
+                // use our write & flush functions
                 png_set_write_fn(png_ptr,
                                  reinterpret_cast<png_voidp *>(&output),
                                  user_io_write,
                                  user_io_flush);
 
-                uintmax_t width = properties.mask_width();
-                uintmax_t height = properties.mask_height();
-                png_colorp palette = nullptr;
-                uint8_t* data_row = nullptr;
+                std::vector<png_color> palette(pixels.palette.size() / 3);
                 bool status = true;
-
                 try
                 {
-                    // 2-palette entries.. one is set to transparent (0x00)
-                    png_byte transp[2] = { 0xff, 0x00 };
-                    png_set_tRNS(png_ptr, info_ptr, transp, 2, nullptr);
-
-                    // save the header chunk
-                    png_set_IHDR(png_ptr, info_ptr, width, height, 1,
-                                 PNG_COLOR_TYPE_PALETTE,
+                    // Set the image information here.  Width and height
+                    // are up to 2^31, bit_depth is one of 1, 2, 4, 8, or
+                    // 16, but valid values also depend on the color_type
+                    // selected. color_type is one of PNG_COLOR_TYPE_GRAY,
+                    // PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE,
+                    // PNG_COLOR_TYPE_RGB, or PNG_COLOR_TYPE_RGB_ALPHA.
+                    // interlace is either PNG_INTERLACE_NONE or
+                    // PNG_INTERLACE_ADAM7, and the compression_type and
+                    // filter_type MUST currently be
+                    // PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE.
+                    //
+                    png_set_IHDR(png_ptr, info_ptr, pixels.width, pixels.height, pixels.bit_depth,
+                                 format_to_png_type(pixels.format),
                                  PNG_INTERLACE_NONE,
                                  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
-                    if (pdftoedn::options.libpng_use_best_compression()) {
-                        png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+                    switch (codec.type)
+                    {
+                      case ImageCodec::PNG_FAST:
+                          // a single filter instead of libpng's
+                          // per-row search and the fastest zlib
+                          // level. Palettes and packed pixels don't
+                          // gain from filtering
+                          png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE,
+                                         ((pixels.format == PixelData::FORMAT_PALETTE || pixels.bit_depth < 8) ?
+                                          PNG_FILTER_NONE : PNG_FILTER_SUB));
+                          png_set_compression_level(png_ptr, Z_BEST_SPEED);
+                          break;
+                      case ImageCodec::PNG_BEST:
+                          png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+                          break;
+                      default:
+                          break;
                     }
 
-                    // set the palette
-                    palette = reinterpret_cast<png_colorp>( png_malloc(png_ptr, 2 * sizeof(png_colorp)) );
-                    if (!palette) {
-                        std::stringstream err;
-                        err << __FUNCTION__ << "() - couldn't alloc storage for image palette";
-                        throw std::runtime_error(err.str());
+                    if (!palette.empty()) {
+                        for (size_t i = 0; i < palette.size(); i++) {
+                            palette[i].red   = pixels.palette[3 * i];
+                            palette[i].green = pixels.palette[3 * i + 1];
+                            palette[i].blue  = pixels.palette[3 * i + 2];
+                        }
+                        png_set_PLTE(png_ptr, info_ptr, palette.data(), palette.size());
                     }
 
-                    palette[0].red   = properties.mask_fill_color().red();
-                    palette[0].green = properties.mask_fill_color().green();
-                    palette[0].blue  = properties.mask_fill_color().blue();
-
-                    // by default set the 2nd color to white.. leptonica
-                    // does not preserve transparency so this should make
-                    // it match white background at least
-                    palette[1].red   = palette[1].green = palette[1].blue = 0xff;
-                    png_set_PLTE(png_ptr, info_ptr, palette, 2);
+                    if (!pixels.transparency.empty()) {
+                        png_set_tRNS(png_ptr, info_ptr, pixels.transparency.data(),
+                                     pixels.transparency.size(), nullptr);
+                    }
 
                     // Write the file header information.
                     png_write_info(png_ptr, info_ptr);
 
                     // pack pixels into bytes
                     png_set_packing(png_ptr);
-                    // swap bits of 1, 2, 4 bit packed pixel formats - we
-                    // don't need this but I've found some images in PDFs
-                    // that cause a segfault when this is disabled. Ugh.
-                    png_set_packswap(png_ptr);
-
-                    data_row = new uint8_t[ width ];
-                    if (!data_row) {
-                        std::stringstream err;
-                        err << __FUNCTION__ << "() - couldn't alloc storage for image row buffer";
-                        throw std::runtime_error(err.str());
-                    }
 
-                    // reset the poppler image stream
-                    img_str->reset();
+                    // swap bits of 1, 2, 4 bit packed pixel formats - I've
+                    // found some images in PDFs that cause a segfault
+                    // when this is disabled. Ugh.
+                    png_set_packswap(png_ptr);
 
-                    for (size_t y = 0; y < height; y++) {
-                        unsigned char* pix = img_str->getLine();
-                        for (size_t x = 0; x < width; x++) {
-                            data_row[x] = (properties.mask_is_inverted() ? !pix[x] : pix[x]);
-                        }
-                        png_write_rows(png_ptr, &data_row, 1);
+                    // libpng copies each row before filtering it so the
+                    // rows can be handed over directly
+                    for (size_t y = 0; y < pixels.height; y++) {
+                        png_bytep row = const_cast<png_bytep>(pixels.output_row(y));
+                        png_write_rows(png_ptr, &row, 1);
                     }
 
+                    // finish writing the rest of the file
                     png_write_end(png_ptr, info_ptr);
                 }
                 catch (libpng_error& e) {
@@ -689,19 +941,253 @@ namespace pdftoedn
                     status = false;
                 }
 
-                // cleanup
-                img_str->close();
+                // clean up after the write, and free any memory allocated
+                png_destroy_write_struct(&png_ptr, &info_ptr);
+                return status;
+            }
+
+
+            // -------------------------------------------------------------------------------
+            // other formats take 8-bit RGB or RGBA samples
+            //
+            static uint8_t rgba_channels(const PixelData& pixels)
+            {
+                return ((pixels.format == PixelData::FORMAT_GRAY_ALPHA ||
+                         pixels.format == PixelData::FORMAT_RGB_ALPHA ||
+                         !pixels.transparency.empty()) ? 4 : 3);
+            }
+
+            //
+            // expands a row of palette indices, gray or 16-bit samples
+            // into 8-bit RGB(A). 16-bit samples are stored big-endian
+            // for libpng so the high byte comes first
+            static void expand_row(const PixelData& pixels, uint32_t y, uint8_t channels, uint8_t* out)
+            {
+                const uint8_t* in = pixels.output_row(y);
+                std::size_t step = (pixels.bit_depth > 8 ? 2 : 1);
+                unsigned max = (pixels.bit_depth >= 8 ? 0xff : (1u << pixels.bit_depth) - 1);
+                auto level = [max](uint8_t v) -> uint8_t {
+                    return static_cast<uint8_t>(max == 0xff ? v : (v * 0xff) / max);
+                };
+
+                for (uint32_t x = 0; x < pixels.width; x++, out += channels) {
+                    uint8_t alpha = 0xff;
 
-                delete [] data_row;
+                    switch (pixels.format)
+                    {
+                      case PixelData::FORMAT_PALETTE:
+                          {
+                              std::size_t i = *in++;
+                              if (3 * i + 2 < pixels.palette.size()) {
+                                  std::memcpy(out, &pixels.palette[3 * i], 3);
+                              } else {
+                                  out[0] = out[1] = out[2] = 0;
+                              }
+                              if (i < pixels.transparency.size()) {
+                                  alpha = pixels.transparency[i];
+                              }
+                          }
+                          break;
+                      case PixelData::FORMAT_GRAY:
+                          out[0] = out[1] = out[2] = level(in[0]);
+                          in += step;
+                          break;
+                      case PixelData::FORMAT_GRAY_ALPHA:
+                          out[0] = out[1] = out[2] = level(in[0]);
+                          alpha = level(in[step]);
+                          in += 2 * step;
+                          break;
+                      case PixelData::FORMAT_RGB:
+                          out[0] = level(in[0]);
+                          out[1] = level(in[step]);
+                          out[2] = level(in[2 * step]);
+                          in += 3 * step;
+                          break;
+                      case PixelData::FORMAT_RGB_ALPHA:
+                          out[0] = level(in[0]);
+                          out[1] = level(in[step]);
+                          out[2] = level(in[2 * step]);
+                          alpha = level(in[3 * step]);
+                          in += 4 * step;
+                          break;
+                    }
 
-                if (palette) {
-                    png_free(png_ptr, palette);
+                    if (channels == 4) {
+                        out[3] = alpha;
+                    }
                 }
+            }
 
-                // clean up after the write, and free any memory allocated
-                png_destroy_write_struct(&png_ptr, &info_ptr);
 
-                return status;
+            //
+            // "Quite OK Image" format - https://qoiformat.org/qoi-specification.pdf
+            //
+            // A single pass over the pixels with no compression library
+            // so it is much faster to write than a PNG, at the cost of
+            // larger files
+            static bool encode_qoi(ImageBuffer& output, const PixelData& pixels)
+            {
+                enum {
+                    QOI_OP_INDEX = 0x00,
+                    QOI_OP_DIFF  = 0x40,
+                    QOI_OP_LUMA  = 0x80,
+                    QOI_OP_RUN   = 0xc0,
+                    QOI_OP_RGB   = 0xfe,
+                    QOI_OP_RGBA  = 0xff,
+                };
+                static const uint8_t QOI_END_MARKER[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+                struct rgba_t {
+                    uint8_t r, g, b, a;
+                    bool operator==(const rgba_t& o) const {
+                        return (r == o.r && g == o.g && b == o.b && a == o.a);
+                    }
+                };
+
+                uint8_t channels = rgba_channels(pixels);
+                std::vector<uint8_t> row(static_cast<std::size_t>(pixels.width) * channels);
+                std::vector<char> out;
+                out.reserve(static_cast<std::size_t>(pixels.width) * (channels + 1) + 14);
+
+                auto put32 = [&out](uint32_t v) {
+                    out.push_back(static_cast<char>(v >> 24));
+                    out.push_back(static_cast<char>(v >> 16));
+                    out.push_back(static_cast<char>(v >> 8));
+                    out.push_back(static_cast<char>(v));
+                };
+
+                // header
+                out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+                put32(pixels.width);
+                put32(pixels.height);
+                out.push_back(static_cast<char>(channels));
+                out.push_back(0); // sRGB with linear alpha
+
+                rgba_t index[64] = {};
+                rgba_t prev = { 0, 0, 0, 0xff };
+                uintmax_t run = 0;
+                uintmax_t remaining = static_cast<uintmax_t>(pixels.width) * pixels.height;
+
+                for (uint32_t y = 0; y < pixels.height; y++) {
+                    expand_row(pixels, y, channels, row.data());
+
+                    const uint8_t* p = row.data();
+                    for (uint32_t x = 0; x < pixels.width; x++, p += channels) {
+                        rgba_t px = { p[0], p[1], p[2], (channels == 4 ? p[3] : prev.a) };
+                        remaining--;
+
+                        if (px == prev) {
+                            if (++run == 62 || remaining == 0) {
+                                out.push_back(static_cast<char>(QOI_OP_RUN | (run - 1)));
+                                run = 0;
+                            }
+                            continue;
+                        }
+
+                        if (run > 0) {
+                            out.push_back(static_cast<char>(QOI_OP_RUN | (run - 1)));
+                            run = 0;
+                        }
+
+                        uint8_t pos = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+                        if (index[pos] == px) {
+                            out.push_back(static_cast<char>(QOI_OP_INDEX | pos));
+                        }
+                        else {
+                            index[pos] = px;
+
+                            if (px.a == prev.a) {
+                                int8_t vr = static_cast<int8_t>(px.r - prev.r);
+                                int8_t vg = static_cast<int8_t>(px.g - prev.g);
+                                int8_t vb = static_cast<int8_t>(px.b - prev.b);
+                                int8_t vg_r = static_cast<int8_t>(vr - vg);
+                                int8_t vg_b = static_cast<int8_t>(vb - vg);
+
+                                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                                    out.push_back(static_cast<char>(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                                }
+                                else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                                    out.push_back(static_cast<char>(QOI_OP_LUMA | (vg + 32)));
+                                    out.push_back(static_cast<char>((vg_r + 8) << 4 | (vg_b + 8)));
+                                }
+                                else {
+                                    out.insert(out.end(), { static_cast<char>(QOI_OP_RGB),
+                                                static_cast<char>(px.r), static_cast<char>(px.g), static_cast<char>(px.b) });
+                                }
+                            }
+                            else {
+                                out.insert(out.end(), { static_cast<char>(QOI_OP_RGBA),
+                                            static_cast<char>(px.r), static_cast<char>(px.g),
+                                            static_cast<char>(px.b), static_cast<char>(px.a) });
+                            }
+                        }
+                        prev = px;
+                    }
+
+                    // hand over a row at a time
+                    output.write(out.data(), out.size());
+                    out.clear();
+                }
+
+                output.write(QOI_END_MARKER, sizeof(QOI_END_MARKER));
+                return true;
+            }
+
+
+#ifdef HAVE_LIBWEBP
+            //
+            // lossless WebP via libwebp
+            static bool encode_webp_lossless(ImageBuffer& output, const PixelData& pixels)
+            {
+                if (pixels.width > WEBP_MAX_DIMENSION || pixels.height > WEBP_MAX_DIMENSION) {
+                    std::stringstream err;
+                    err << __FUNCTION__ << " - " << pixels.width << "x" << pixels.height
+                        << " image exceeds the WebP size limit";
+                    et.log_critical( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE, err.str() );
+                    return false;
+                }
+
+                uint8_t channels = rgba_channels(pixels);
+                std::size_t stride = static_cast<std::size_t>(pixels.width) * channels;
+                RowBuffer rgba;
+                rgba.assign(stride * pixels.height);
+                for (uint32_t y = 0; y < pixels.height; y++) {
+                    expand_row(pixels, y, channels, rgba.data() + y * stride);
+                }
+
+                uint8_t* webp = nullptr;
+                std::size_t size = ((channels == 4) ?
+                                    WebPEncodeLosslessRGBA(rgba.data(), pixels.width, pixels.height, stride, &webp) :
+                                    WebPEncodeLosslessRGB(rgba.data(), pixels.width, pixels.height, stride, &webp));
+                if (size == 0) {
+                    et.log_critical( ErrorTracker::ERROR_UT_IMAGE_ENCODE, MODULE, "WebP encoding failed" );
+                    return false;
+                }
+
+                output.write(webp, size);
+                WebPFree(webp);
+                return true;
+            }
+#endif
+
+
+            //
+            // export the rows in the given format into a buffer
+            bool encode(ImageBuffer& output, const PixelData& pixels, const ImageCodec& codec)
+            {
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_ENCODE);
+
+                switch (codec.type)
+                {
+                  case ImageCodec::QOI:
+                      return encode_qoi(output, pixels);
+#ifdef HAVE_LIBWEBP
+                  case ImageCodec::WEBP_LOSSLESS:
+                      return encode_webp_lossless(output, pixels);
+#endif
+                  default:
+                      return encode_png(output, pixels, codec);
+                }
             }
 
 
@@ -709,7 +1195,7 @@ namespace pdftoedn
             //
             // export the data to PNG, forcing grayscale output instead of palletized
             //
-            bool encode_grey_image(std::ostream& output, ImageStream* img_str,
+            bool encode_grey_image(ImageBuffer& output, ImageStream* img_str,
                                    const StreamProps& properties,
                                    GfxImageColorMap *color_map)
             {
@@ -20,6 +20,12 @@
 
 #include <string>
 #include <ostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+
+#include "runtime_options.h"
+#include "util.h"
 
 namespace pdftoedn
 {
@@ -27,15 +33,142 @@ namespace pdftoedn
     {
         namespace encode {
 
-            bool encode_image(std::ostream& output, ImageStream* img_str, const StreamProps& properties,
-                              GfxImageColorMap *colorMap);
-            bool encode_rgba_image(std::ostream& output, ImageStream* img_str, ImageStream* mask_str,
-                                   const StreamProps& properties,
-                                   GfxImageColorMap *color_map, GfxImageColorMap *mask_color_map,
-                                   bool mask_invert);
-            bool encode_mask(std::ostream& output, ImageStream* img_str, const StreamProps& properties);
+            //
+            // zero-filled storage for image rows. Buffers larger than
+            // --image_memory_limit are mapped from a temporary file
+            // so very large images don't have to stay resident
+            class RowBuffer {
+            public:
+                RowBuffer() : mapping(nullptr), mapped_length(0) { }
+                RowBuffer(RowBuffer&& other) : RowBuffer() { swap(other); }
+                RowBuffer& operator=(RowBuffer&& other) { swap(other); return *this; }
+                ~RowBuffer() { release(); }
+
+                void assign(std::size_t length);
+                uint8_t* data() { return (mapping ? mapping : mem.data()); }
+                const uint8_t* data() const { return (mapping ? mapping : mem.data()); }
+                bool is_mapped() const { return (mapping != nullptr); }
+
+            private:
+                std::vector<uint8_t> mem;
+                uint8_t* mapping;
+                std::size_t mapped_length;
+
+                void release();
+                void swap(RowBuffer& other);
+
+                RowBuffer(const RowBuffer&) = delete;
+                RowBuffer& operator=(const RowBuffer&) = delete;
+            };
+
+            //
+            // image rows as they are handed to libpng (one byte per
+            // sample, packed by libpng). Reading them from poppler is
+            // kept separate from the PNG encoding so the latter does
+            // not need poppler and can run on a worker thread
+            struct PixelData {
+                enum format_type {
+                    FORMAT_PALETTE,
+                    FORMAT_GRAY,
+                    FORMAT_RGB,
+                    FORMAT_GRAY_ALPHA,
+                    FORMAT_RGB_ALPHA,
+                };
+
+                PixelData() : format(FORMAT_RGB), width(0), height(0), bit_depth(8), bottom_up(false) { }
+
+                format_type format;
+                uint32_t width;
+                uint32_t height;
+                uint8_t bit_depth;
+                // rows are stored bottom to top (flipped vertically)
+                bool bottom_up;
+                std::vector<uint8_t> palette;      // RGB triplets
+                std::vector<uint8_t> transparency; // alpha for palette entries
+                RowBuffer rows;
+
+                // allocates the rows for the given format and size
+                void resize(format_type fmt, uint32_t w, uint32_t h, uint8_t bpp);
+                std::size_t row_size() const;
+                uint8_t* row(uint32_t y) { return rows.data() + y * row_size(); }
+                const uint8_t* row(uint32_t y) const { return rows.data() + y * row_size(); }
+                // rows in the order they are encoded
+                const uint8_t* output_row(uint32_t y) const { return row(bottom_up ? height - 1 - y : y); }
+            };
+
+            //
+            // growable buffer the encoders write to. The md5 is
+            // updated as data is written so it's ready as soon as
+            // encoding is done - unless hashing is disabled because
+            // the data will be replaced (e.g., by a transformation).
+            // Large images are written straight to a file instead
+            class ImageBuffer {
+            public:
+                ImageBuffer(bool hash_data = true) : hashing(hash_data), length(0) { }
+
+                // send the data to a file instead of keeping it
+                bool open_file(const std::string& filename) {
+                    file.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+                    return file.is_open();
+                }
+                bool close_file() {
+                    file.close();
+                    return !file.fail();
+                }
+
+                void write(const void* data, std::size_t size) {
+                    if (file.is_open()) {
+                        file.write(reinterpret_cast<const char*>(data), size);
+                    } else {
+                        buf.append(reinterpret_cast<const char*>(data), size);
+                    }
+                    length += size;
+                    if (hashing) {
+                        hash.update(data, size);
+                    }
+                }
+
+                // the data can be moved out of the buffer
+                std::string& data() { return buf; }
+                std::size_t size() const { return length; }
+                std::string md5() { return hash.hexdigest(); }
+
+            private:
+                std::string buf;
+                std::ofstream file;
+                bool hashing;
+                std::size_t length;
+                util::MD5Hash hash;
+            };
+
+            // read and color-convert image data from poppler streams
+            bool read_image(PixelData& pixels, ImageStream* img_str, const StreamProps& properties,
+                            GfxImageColorMap *colorMap);
+            bool read_rgba_image(PixelData& pixels, ImageStream* img_str, ImageStream* mask_str,
+                                 const StreamProps& properties,
+                                 GfxImageColorMap *color_map, GfxImageColorMap *mask_color_map,
+                                 bool mask_invert);
+            bool read_mask(PixelData& pixels, ImageStream* img_str, const StreamProps& properties);
+
+            // shrink the image to width x height with a box filter
+            void downsample(PixelData& pixels, uint32_t width, uint32_t height);
+
+            // rotate (clockwise, by 90, 180 or 270 degrees) then flip
+            // the image like util::xform::transform_image() does
+            void orient(PixelData& pixels, int rotation, bool flip_h, bool flip_v);
+
+            // copy the data of a JPEG or JPX stream as it is stored
+            bool read_encoded_stream(std::string& data, Stream* str);
+
+            // fingerprint an image by its undecoded data and the colors
+            // its samples map to (--image_cache)
+            bool hash_raw_stream(util::MD5Hash& hash, Stream* str);
+            void hash_color_map(util::MD5Hash& hash, GfxImageColorMap* colorMap);
+
+            // export the rows in the given format into a buffer
+            bool encode(ImageBuffer& output, const PixelData& pixels, const ImageCodec& codec);
 #if 0
-            bool encode_grey_image(std::ostream& output, ImageStream* img_str, const StreamProps& properties,
+            bool encode_grey_image(ImageBuffer& output, ImageStream* img_str, const StreamProps& properties,
                                    GfxImageColorMap *colorMap);
 #endif
         }
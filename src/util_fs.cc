@@ -18,12 +18,29 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
 #include <fstream>
+#include <cstdlib>
 #include <iostream>
 #include <boost/filesystem.hpp>
 #include <wordexp.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "util_fs.h"
 #include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
 #include "runtime_options.h"
 
 namespace pdftoedn
@@ -110,24 +127,110 @@ namespace pdftoedn
                     return true;
                 }
 
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_WRITE);
+
                 // TODO: overwrite is now false by default but maybe
                 // check if destination is the same and overwrite?
-                if (overwrite || !boost::filesystem::exists(filename))
-                {
-                    std::ofstream file;
-                    file.open(filename.c_str());
+                if (!overwrite && boost::filesystem::exists(filename)) {
+                    stats.count(StatsTracker::COUNT_IMAGES_REUSED);
+                    return true;
+                }
 
-                    if (!file.is_open()) {
-                        return false;
+                // write to a temporary file and rename it so a file
+                // named by its content (--dedup_images) that is being
+                // written by another worker is never seen truncated
+                boost::filesystem::path tmp_path(filename);
+                tmp_path += boost::filesystem::unique_path(".%%%%-%%%%.tmp");
+
+                std::ofstream file;
+                file.open(tmp_path.c_str(), std::ios::binary);
+
+                if (!file.is_open()) {
+                    return false;
+                }
+
+                file.write(blob.data(), blob.size());
+                file.close();
+
+                boost::system::error_code ec;
+                if (file) {
+                    boost::filesystem::rename(tmp_path, filename, ec);
+                    if (!ec) {
+                        return true;
                     }
+                }
+
+                boost::filesystem::remove(tmp_path, ec);
+                return false;
+            }
+
+
+            //
+            // move an image that was encoded straight to a temporary
+            // file into place. Same rules as write_image_to_disk()
+            bool move_image_to_disk(const std::string& tmp_filename, const std::string& filename,
+                                    bool overwrite)
+            {
+                boost::system::error_code ec;
+
+                if (options.edn_output_only()) {
+                    boost::filesystem::remove(tmp_filename, ec);
+                    return true;
+                }
+
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_WRITE);
 
-                    file << blob;
-                    file.close();
+                if (!overwrite && boost::filesystem::exists(filename)) {
+                    boost::filesystem::remove(tmp_filename, ec);
+                    stats.count(StatsTracker::COUNT_IMAGES_REUSED);
+                    return true;
+                }
+
+                boost::filesystem::rename(tmp_filename, filename, ec);
+                if (ec) {
+                    boost::filesystem::remove(tmp_filename, ec);
+                    return false;
                 }
                 return true;
             }
 
 
+            //
+            // hard link a file, or copy it if that fails (e.g., the
+            // paths are on different file systems). Nothing is done
+            // if the destination exists
+            bool link_file(const std::string& from, const std::string& to)
+            {
+                namespace fs = boost::filesystem;
+
+                if (fs::exists(to)) {
+                    return true;
+                }
+
+                boost::system::error_code ec;
+                fs::create_hard_link(from, to, ec);
+                if (!ec || fs::exists(to)) {
+                    return true;
+                }
+
+                // copy to a temporary file so the destination is
+                // never seen incomplete
+                fs::path tmp_path(to);
+                tmp_path += fs::unique_path(".%%%%-%%%%.tmp");
+
+                fs::copy_file(from, tmp_path, ec);
+                if (!ec) {
+                    fs::rename(tmp_path, to, ec);
+                    if (!ec) {
+                        return true;
+                    }
+                }
+
+                fs::remove(tmp_path, ec);
+                return false;
+            }
+
+
             //
             // opens file, reads size, allocates buffer for storage
             // (pointed to by *data), and copies content to it. NOTE:
@@ -156,6 +259,140 @@ namespace pdftoedn
                 return true;
             }
 
+
+            //
+            // reads the stream until EOF (used for stdin, where the
+            // size is not known ahead of time)
+            bool read_stream(std::istream& in, std::string& data)
+            {
+                static const std::size_t CHUNK_SIZE = 64 * 1024;
+
+                data.clear();
+                char buf[CHUNK_SIZE];
+                while (in.read(buf, CHUNK_SIZE) || in.gcount() > 0) {
+                    data.append(buf, in.gcount());
+                }
+                return !in.bad();
+            }
+
+
+            //
+            // maps the file read-only into memory. Returns false if
+            // the file can't be mapped (mmap unavailable, empty
+            // file, etc.) so callers can fall back to regular reads
+            bool map_file(const std::string& filename, char** data, uintmax_t& length)
+            {
+                *data = nullptr;
+                length = 0;
+
+#ifdef HAVE_SYS_MMAN_H
+                int fd = open(filename.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+                    close(fd);
+                    return false;
+                }
+
+                void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                // the mapping holds its own reference to the file
+                close(fd);
+
+                if (mapping == MAP_FAILED) {
+                    return false;
+                }
+
+                // pages are mostly read in order so ask for aggressive
+                // read-ahead and start loading the file right away
+#ifdef MADV_SEQUENTIAL
+                madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+                madvise(mapping, st.st_size, MADV_WILLNEED);
+#endif
+
+                *data = static_cast<char*>(mapping);
+                length = st.st_size;
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            void unmap_file(char* data, uintmax_t length)
+            {
+#ifdef HAVE_SYS_MMAN_H
+                if (data) {
+                    munmap(data, length);
+                }
+#endif
+            }
+
+            //
+            // maps a zero-filled temporary file in dir as scratch
+            // memory the OS can write out instead of keeping it
+            // resident. The file is unlinked right away so it's
+            // removed once unmapped (with unmap_file) or if the
+            // process exits. Its blocks are allocated up front as
+            // running out of space while writing to a sparse mapping
+            // raises SIGBUS; if they can't be, false is returned
+            bool map_scratch_file(const std::string& dir, uintmax_t length, char** data)
+            {
+                *data = nullptr;
+
+#ifdef HAVE_SYS_MMAN_H
+                if (!create_fs_dir(dir)) {
+                    return false;
+                }
+
+                std::string tmp_name = (boost::filesystem::path(dir) / ".pdftoedn-XXXXXX").string();
+                int fd = mkstemp(&tmp_name[0]);
+                if (fd < 0) {
+                    return false;
+                }
+                unlink(tmp_name.c_str());
+
+#ifdef HAVE_POSIX_FALLOCATE
+                bool allocated = (posix_fallocate(fd, 0, length) == 0);
+#else
+                // write the zeros out instead
+                std::vector<char> zeros(std::min<uintmax_t>(length, 1024 * 1024), 0);
+                uintmax_t remaining = length;
+                while (remaining > 0) {
+                    ssize_t written = write(fd, zeros.data(), std::min<uintmax_t>(remaining, zeros.size()));
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    remaining -= written;
+                }
+                bool allocated = (remaining == 0);
+#endif
+                if (!allocated) {
+                    close(fd);
+                    return false;
+                }
+
+                void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+
+                if (mapping == MAP_FAILED) {
+                    return false;
+                }
+
+                *data = static_cast<char*>(mapping);
+                return true;
+#else
+                return false;
+#endif
+            }
+
         } // fs
     } // util
 } // namespace
@@ -31,7 +31,14 @@ namespace pdftoedn
             bool check_valid_input_file(const boost::filesystem::path& infile);
             bool write_image_to_disk(const std::string& filename, const std::string& blob,
                                      bool overwrite = false);
+            bool move_image_to_disk(const std::string& tmp_filename, const std::string& filename,
+                                    bool overwrite = false);
+            bool link_file(const std::string& from, const std::string& to);
             bool read_text_file(const std::string& filename, char** data);
+            bool read_stream(std::istream& in, std::string& data);
+            bool map_file(const std::string& filename, char** data, uintmax_t& length);
+            void unmap_file(char* data, uintmax_t length);
+            bool map_scratch_file(const std::string& dir, uintmax_t length, char** data);
         }
     }
 }
@@ -0,0 +1,111 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+#include "pdf_error_tracker.h"
+#include "runtime_options.h"
+#include "util_fs.h"
+#include "util_image_cache.h"
+
+namespace pdftoedn
+{
+    namespace util
+    {
+        namespace image_cache
+        {
+            static const char* MODULE = "ImageCache";
+            static const char* INDEX_FILE_EXT = ".fp";
+
+            //
+            // each fingerprint has an index file holding the md5 and
+            // size of the image. The images are named by their md5
+            // so different streams that encode the same share it
+            static std::string index_path(const std::string& fingerprint)
+            {
+                boost::filesystem::path path(options.image_cache_dir());
+                path.append(fingerprint + INDEX_FILE_EXT);
+                return path.string();
+            }
+
+            static std::string image_path(const std::string& md5, const ImageCodec& codec)
+            {
+                boost::filesystem::path path(options.image_cache_dir());
+                path.append(md5 + codec.file_ext());
+                return path.string();
+            }
+
+
+            //
+            // find the image a fingerprint was encoded to
+            bool lookup(const std::string& fingerprint, const ImageCodec& codec, Entry& entry)
+            {
+                std::ifstream index(index_path(fingerprint));
+                if (!index.is_open()) {
+                    return false;
+                }
+
+                if (!(index >> entry.md5 >> entry.width >> entry.height) ||
+                    entry.width <= 0 || entry.height <= 0) {
+                    std::stringstream err;
+                    err << "ignoring invalid image cache entry " << fingerprint;
+                    et.log_warn( ErrorTracker::ERROR_PAGE_DATA, MODULE, err.str() );
+                    return false;
+                }
+
+                // the image may have been removed from the cache
+                // since the index was written
+                entry.file_path = image_path(entry.md5, codec);
+                return boost::filesystem::exists(entry.file_path);
+            }
+
+
+            //
+            // add a written image. The image is linked into the cache
+            // before the index is written so entries that are found
+            // always have their data
+            bool store(const std::string& fingerprint, const ImageCodec& codec,
+                       const std::string& image_file_path, const std::string& md5,
+                       int width, int height)
+            {
+                if (!util::fs::link_file(image_file_path, image_path(md5, codec))) {
+                    std::stringstream err;
+                    err << "error adding '" << image_file_path << "' to the image cache";
+                    et.log_warn( ErrorTracker::ERROR_PAGE_DATA, MODULE, err.str() );
+                    return false;
+                }
+
+                std::stringstream index;
+                index << md5 << " " << width << " " << height << std::endl;
+
+                if (!util::fs::write_image_to_disk(index_path(fingerprint), index.str(), true)) {
+                    std::stringstream err;
+                    err << "error writing image cache entry " << fingerprint;
+                    et.log_warn( ErrorTracker::ERROR_PAGE_DATA, MODULE, err.str() );
+                    return false;
+                }
+                return true;
+            }
+
+        } // namespace image_cache
+    } // namespace util
+} // namespace
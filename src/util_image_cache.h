@@ -0,0 +1,51 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <string>
+
+namespace pdftoedn
+{
+    struct ImageCodec;
+
+    namespace util
+    {
+        //
+        // defined in util_image_cache.cc. Persistent directory
+        // (--image_cache) mapping the fingerprint of an image's
+        // undecoded stream and decode parameters to the image it was
+        // encoded to so it's not decoded again by later uses, within
+        // the run or in others
+        namespace image_cache {
+            struct Entry {
+                Entry() : width(0), height(0) { }
+
+                std::string file_path;
+                std::string md5;
+                int width, height;
+            };
+
+            bool lookup(const std::string& fingerprint, const ImageCodec& codec, Entry& entry);
+            bool store(const std::string& fingerprint, const ImageCodec& codec,
+                       const std::string& image_file_path, const std::string& md5,
+                       int width, int height);
+        }
+    }
+}
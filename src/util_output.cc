@@ -0,0 +1,502 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cstdio>
+#include <clocale>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "util_output.h"
+
+namespace pdftoedn
+{
+    namespace util
+    {
+        namespace output
+        {
+            // size of the chunks compressed output is produced in
+            static const std::size_t COMPRESS_CHUNK_SIZE = 128 * 1024;
+
+#ifdef HAVE_LIBZ
+            // ==========================================================
+            // gzip via zlib's deflate
+            //
+            class GzipCompressor : public Compressor
+            {
+            public:
+                GzipCompressor(int level) {
+                    strm.zalloc = Z_NULL;
+                    strm.zfree = Z_NULL;
+                    strm.opaque = Z_NULL;
+                    // 15 + 16 = max window with a gzip header
+                    ok = (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+                }
+                virtual ~GzipCompressor() {
+                    if (ok) {
+                        deflateEnd(&strm);
+                    }
+                }
+
+                virtual bool compress(const char* data, std::size_t len, bool finish,
+                                      std::vector<char>& out)
+                {
+                    if (!ok) {
+                        return false;
+                    }
+
+                    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                    strm.avail_in = len;
+
+                    int flush = (finish ? Z_FINISH : Z_NO_FLUSH);
+                    int rc;
+                    do {
+                        std::size_t offset = out.size();
+                        out.resize(offset + COMPRESS_CHUNK_SIZE);
+                        strm.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+                        strm.avail_out = COMPRESS_CHUNK_SIZE;
+
+                        rc = deflate(&strm, flush);
+                        out.resize(out.size() - strm.avail_out);
+
+                        if (rc == Z_STREAM_ERROR) {
+                            ok = false;
+                            return false;
+                        }
+                    } while (strm.avail_out == 0 || (finish && rc != Z_STREAM_END));
+                    return true;
+                }
+
+                virtual const char* file_ext() const { return ".gz"; }
+
+            private:
+                z_stream strm;
+                bool ok;
+            };
+#endif
+
+#ifdef HAVE_LIBZSTD
+            // ==========================================================
+            // zstd. If libzstd is built with thread support, frames
+            // are compressed by a worker thread so compression
+            // overlaps with extraction
+            //
+            class ZstdCompressor : public Compressor
+            {
+            public:
+                ZstdCompressor(int level) :
+                    cctx(ZSTD_createCCtx())
+                {
+                    if (cctx) {
+                        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+                        // fails harmlessly if not built with threads
+                        ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, 1);
+                    }
+                }
+                virtual ~ZstdCompressor() {
+                    ZSTD_freeCCtx(cctx);
+                }
+
+                virtual bool compress(const char* data, std::size_t len, bool finish,
+                                      std::vector<char>& out)
+                {
+                    if (!cctx) {
+                        return false;
+                    }
+
+                    ZSTD_inBuffer in = { data, len, 0 };
+                    ZSTD_EndDirective mode = (finish ? ZSTD_e_end : ZSTD_e_continue);
+                    std::size_t remaining;
+                    do {
+                        std::size_t offset = out.size();
+                        out.resize(offset + COMPRESS_CHUNK_SIZE);
+                        ZSTD_outBuffer zout = { &out[offset], COMPRESS_CHUNK_SIZE, 0 };
+
+                        remaining = ZSTD_compressStream2(cctx, &zout, &in, mode);
+                        out.resize(offset + zout.pos);
+
+                        if (ZSTD_isError(remaining)) {
+                            return false;
+                        }
+                    } while (finish ? (remaining != 0) : (in.pos < in.size));
+                    return true;
+                }
+
+                virtual const char* file_ext() const { return ".zst"; }
+
+            private:
+                ZSTD_CCtx* cctx;
+            };
+#endif
+
+            //
+            // "gzip", "gzip:9", "zstd", "zstd:19", ...
+            Compressor* Compressor::create(const std::string& spec)
+            {
+                std::string format = spec.substr(0, spec.find(':'));
+                bool has_level = (format.size() < spec.size());
+                int level = 0;
+
+                if (has_level) {
+                    std::istringstream level_str(spec.substr(format.size() + 1));
+                    if (!(level_str >> level) || !level_str.eof()) {
+                        throw std::logic_error("Invalid compression level in '" + spec + "'.");
+                    }
+                }
+
+                int min_level, max_level;
+                if (format == "gzip") {
+#ifdef HAVE_LIBZ
+                    min_level = 1;
+                    max_level = 9;
+                    if (!has_level) {
+                        level = Z_DEFAULT_COMPRESSION;
+                    }
+#else
+                    throw std::logic_error("gzip compression is not supported by this build.");
+#endif
+                }
+                else if (format == "zstd") {
+#ifdef HAVE_LIBZSTD
+                    min_level = 1;
+                    max_level = ZSTD_maxCLevel();
+                    if (!has_level) {
+                        level = ZSTD_CLEVEL_DEFAULT;
+                    }
+#else
+                    throw std::logic_error("zstd compression is not supported by this build.");
+#endif
+                }
+                else {
+                    throw std::logic_error("Unsupported compression format '" + format + "' (use 'gzip' or 'zstd').");
+                }
+
+                if (has_level && (level < min_level || level > max_level)) {
+                    std::stringstream err;
+                    err << format << " compression level must be between "
+                        << min_level << " and " << max_level << ".";
+                    throw std::logic_error(err.str());
+                }
+
+#ifdef HAVE_LIBZ
+                if (format == "gzip") {
+                    return new GzipCompressor(level);
+                }
+#endif
+#ifdef HAVE_LIBZSTD
+                if (format == "zstd") {
+                    return new ZstdCompressor(level);
+                }
+#endif
+                return nullptr;
+            }
+
+
+            // ==========================================================
+            // output sink
+            //
+            Sink::Sink(std::size_t buffer_size) :
+                buffer(buffer_size > 0 ? buffer_size : DEFAULT_BUFFER_SIZE),
+                fd(-1), owns_fd(false), bytes_flushed(0), write_error(false),
+                compressor(nullptr)
+            {
+                setp(buffer.data(), buffer.data() + buffer.size());
+            }
+
+            Sink::~Sink()
+            {
+                close();
+                delete compressor;
+            }
+
+            void Sink::set_compressor(Compressor* c)
+            {
+                delete compressor;
+                compressor = c;
+            }
+
+            //
+            // open the destination file, truncating it if it exists
+            bool Sink::open(const std::string& filename)
+            {
+                if (is_open()) {
+                    return false;
+                }
+
+                fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                owns_fd = true;
+                return is_open();
+            }
+
+            bool Sink::open_stdout()
+            {
+                if (is_open()) {
+                    return false;
+                }
+
+                fd = STDOUT_FILENO;
+                owns_fd = false;
+                return true;
+            }
+
+            bool Sink::close()
+            {
+                if (!is_open()) {
+                    return !write_error;
+                }
+
+                // ends the compressed stream, if any
+                flush_buffer(nullptr, 0, true);
+
+                if (owns_fd && ::close(fd) != 0) {
+                    write_error = true;
+                }
+                fd = -1;
+                return !write_error;
+            }
+
+
+            // ----------------------------------------------------------
+            // std::streambuf interface
+            //
+            Sink::int_type Sink::overflow(int_type c)
+            {
+                if (!flush_buffer()) {
+                    return traits_type::eof();
+                }
+
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    *pptr() = traits_type::to_char_type(c);
+                    pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize Sink::xsputn(const char* s, std::streamsize n)
+            {
+                std::streamsize avail = epptr() - pptr();
+
+                // common case - fits in the buffer
+                if (n <= avail) {
+                    traits_type::copy(pptr(), s, n);
+                    pbump(n);
+                    return n;
+                }
+
+                // small writes fill the buffer and wrap; anything
+                // larger than the buffer goes out along with what's
+                // pending
+                if (static_cast<std::size_t>(n) < buffer.size()) {
+                    traits_type::copy(pptr(), s, avail);
+                    pbump(avail);
+                    if (!flush_buffer()) {
+                        return avail;
+                    }
+                    traits_type::copy(pptr(), s + avail, n - avail);
+                    pbump(n - avail);
+                    return n;
+                }
+
+                return (flush_buffer(s, n) ? n : 0);
+            }
+
+            int Sink::sync()
+            {
+                return (flush_buffer() ? 0 : -1);
+            }
+
+            //
+            // output can't be repositioned but report the current
+            // position so tellp() works
+            Sink::pos_type Sink::seekoff(off_type off, std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which)
+            {
+                if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out)) {
+                    return pos_type(off_type(-1));
+                }
+                return pos_type(off_type(bytes_flushed + (pptr() - pbase())));
+            }
+
+
+            //
+            // write the buffered data (and an optional extra chunk)
+            // to the descriptor, compressing it first if needed
+            bool Sink::flush_buffer(const char* extra, std::size_t extra_len, bool finish)
+            {
+                if (!is_open() || write_error) {
+                    write_error = true;
+                    return false;
+                }
+
+                struct iovec iov[2];
+                int iov_count = 0;
+
+                std::size_t pending = pptr() - pbase();
+                bytes_flushed += pending + extra_len;
+
+                if (compressor) {
+                    compressed.clear();
+                    if (!compressor->compress(pbase(), pending, false, compressed) ||
+                        !compressor->compress(extra, extra_len, finish, compressed)) {
+                        write_error = true;
+                        return false;
+                    }
+
+                    if (!compressed.empty()) {
+                        iov[iov_count].iov_base = compressed.data();
+                        iov[iov_count++].iov_len = compressed.size();
+                    }
+                }
+                else {
+                    if (pending > 0) {
+                        iov[iov_count].iov_base = pbase();
+                        iov[iov_count++].iov_len = pending;
+                    }
+                    if (extra_len > 0) {
+                        iov[iov_count].iov_base = const_cast<char*>(extra);
+                        iov[iov_count++].iov_len = extra_len;
+                    }
+                }
+
+                if (!write_fd(iov, iov_count)) {
+                    return false;
+                }
+
+                setp(buffer.data(), buffer.data() + buffer.size());
+                return true;
+            }
+
+            //
+            // writes the chunks, retrying on partial writes
+            bool Sink::write_fd(struct iovec* cur, int iov_count)
+            {
+                while (iov_count > 0) {
+                    ssize_t written = ::writev(fd, cur, iov_count);
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        write_error = true;
+                        return false;
+                    }
+
+                    // skip over what was written
+                    std::size_t n = written;
+                    while (iov_count > 0 && n >= cur->iov_len) {
+                        n -= cur->iov_len;
+                        cur++;
+                        iov_count--;
+                    }
+                    if (iov_count > 0) {
+                        cur->iov_base = static_cast<char*>(cur->iov_base) + n;
+                        cur->iov_len -= n;
+                    }
+                }
+                return true;
+            }
+
+
+            // ==========================================================
+            // direct EDN writer
+            //
+            Writer& Writer::number(uintmax_t v)
+            {
+                char buf[24];
+                char* p = buf + sizeof(buf);
+                do {
+                    *--p = '0' + (v % 10);
+                    v /= 10;
+                } while (v);
+                return write(p, buf + sizeof(buf) - p);
+            }
+
+            Writer& Writer::number(intmax_t v)
+            {
+                if (v < 0) {
+                    put('-');
+                    // negate as unsigned so INTMAX_MIN doesn't overflow
+                    return number(static_cast<uintmax_t>(0) - static_cast<uintmax_t>(v));
+                }
+                return number(static_cast<uintmax_t>(v));
+            }
+
+            //
+            // same as the ostream default: %g with a precision of
+            // 6. main() sets the C locale from the environment so
+            // swap in a '.' if it uses a different decimal point
+            Writer& Writer::number(double v)
+            {
+                char buf[32];
+                int len = std::snprintf(buf, sizeof(buf), "%.*g", 6, v);
+                if (len <= 0) {
+                    os.setstate(std::ios_base::badbit);
+                    return *this;
+                }
+
+                const char* dp = std::localeconv()->decimal_point;
+                if (dp[0] != '.' || dp[1] != 0) {
+                    std::size_t dp_len = std::strlen(dp);
+                    char* p = std::strstr(buf, dp);
+                    if (dp_len > 0 && p) {
+                        *p = '.';
+                        std::memmove(p + 1, p + dp_len, buf + len - (p + dp_len) + 1);
+                        len -= dp_len - 1;
+                    }
+                }
+                return write(buf, len);
+            }
+
+            //
+            // unescaped runs go out in a single sputn
+            Writer& Writer::string(const std::string& s)
+            {
+                put('"');
+                const char* run = s.data();
+                const char* end = run + s.size();
+                for (const char* p = run; p != end; ++p) {
+                    switch (*p) {
+                      case 0:
+                      case '"':
+                      case '\\':
+                          write(run, p - run);
+                          put('\\');
+                          run = p;
+                          break;
+                    }
+                }
+                write(run, end - run);
+                return put('"');
+            }
+
+        } // output
+    } // util
+} // namespace
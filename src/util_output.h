@@ -0,0 +1,183 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <streambuf>
+#include <ostream>
+#include <ios>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+struct iovec;
+
+namespace pdftoedn
+{
+    namespace util
+    {
+        namespace output {
+
+            // ===========================================================
+            // streaming compressor applied to the output as it is
+            // flushed from the sink
+            //
+            class Compressor
+            {
+            public:
+                enum format_type {
+                    FORMAT_GZIP,
+                    FORMAT_ZSTD,
+                };
+
+                virtual ~Compressor() { }
+
+                // compresses len bytes of data, appending the result
+                // to out. If finish is set, the stream is ended after
+                // the data
+                virtual bool compress(const char* data, std::size_t len, bool finish,
+                                      std::vector<char>& out) = 0;
+
+                // extension for compressed files (e.g., ".gz")
+                virtual const char* file_ext() const = 0;
+
+                // parses "format[:level]". Throws std::logic_error if
+                // the format is unknown or not built in, or if the
+                // level is out of range
+                static Compressor* create(const std::string& spec);
+            };
+
+
+            // ===========================================================
+            // stream buffer used for document output. EDN is written
+            // as many small pieces so this collects them in a large
+            // buffer and writes it straight to the file descriptor
+            // when full. Large writes that don't fit skip the copy and
+            // go out together with what's buffered in a single
+            // writev.
+            //
+            // Use with a std::ostream so all to_edn methods can
+            // write to it as usual:
+            //
+            //   util::output::Sink sink(buf_size);
+            //   sink.open(filename);
+            //   std::ostream o(&sink);
+            //
+            // If a Compressor is set, buffered data is compressed
+            // before it is written.
+            //
+            class Sink : public std::streambuf
+            {
+            public:
+                static const std::size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+
+                Sink(std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+                virtual ~Sink();
+
+                // open a file for writing or use stdout
+                bool open(const std::string& filename);
+                bool open_stdout();
+                bool is_open() const { return (fd >= 0); }
+
+                // flushes and closes - returns false if any write failed
+                bool close();
+
+                bool failed() const { return write_error; }
+
+                // takes ownership of the compressor. Must be set
+                // before anything is written
+                void set_compressor(Compressor* c);
+
+            protected:
+                virtual int_type overflow(int_type c);
+                virtual std::streamsize xsputn(const char* s, std::streamsize n);
+                virtual int sync();
+                virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which);
+
+            private:
+                std::vector<char> buffer;
+                int fd;
+                bool owns_fd;
+                uintmax_t bytes_flushed;
+                bool write_error;
+                Compressor* compressor;
+                std::vector<char> compressed;
+
+                bool flush_buffer(const char* extra = nullptr, std::size_t extra_len = 0,
+                                  bool finish = false);
+                bool write_fd(struct iovec* iov, int iov_count);
+
+                // non-copyable
+                Sink(const Sink&);
+                Sink& operator=(const Sink&);
+            };
+
+
+            // ===========================================================
+            // appends EDN tokens straight to a stream's buffer with
+            // sputc / sputn. This skips the sentry and the locale
+            // facets each ostream operator<< goes through, which adds
+            // up since output is made of many small pieces. Values
+            // are formatted as the ostream defaults would (classic
+            // locale, precision 6 for doubles) so output is the
+            // same. A failed write sets badbit on the stream.
+            //
+            //   util::output::Writer w(o);
+            //   w.put('[').number(x).put(' ').number(y).put(']');
+            //
+            class Writer
+            {
+            public:
+                explicit Writer(std::ostream& o) : os(o), sb(o.rdbuf()) {}
+
+                Writer& put(char c) {
+                    if (sb->sputc(c) == std::streambuf::traits_type::eof()) {
+                        os.setstate(std::ios_base::badbit);
+                    }
+                    return *this;
+                }
+                Writer& write(const char* s, std::size_t len) {
+                    if (sb->sputn(s, len) != static_cast<std::streamsize>(len)) {
+                        os.setstate(std::ios_base::badbit);
+                    }
+                    return *this;
+                }
+                Writer& write(const char* s) { return write(s, std::strlen(s)); }
+
+                // :name
+                Writer& symbol(const char* name, std::size_t len) { return put(':').write(name, len); }
+                Writer& boolean(bool b) { return (b ? write("true", 4) : write("false", 5)); }
+                Writer& number(uintmax_t v);
+                Writer& number(intmax_t v);
+                Writer& number(double v);
+                // quoted, with 0, '"', and '\\' escaped
+                Writer& string(const std::string& s);
+
+                // for gemables that still write to the ostream
+                std::ostream& stream() { return os; }
+
+            private:
+                std::ostream& os;
+                std::streambuf* sb;
+            };
+
+        } // output
+    } // util
+} // namespace
@@ -0,0 +1,114 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "util_workers.h"
+
+namespace pdftoedn
+{
+    namespace util
+    {
+        // number of queued tasks allowed per thread
+        static const std::size_t TASKS_PER_THREAD = 2;
+
+        WorkerPool::WorkerPool(std::size_t num_threads) :
+            max_queued(num_threads * TASKS_PER_THREAD),
+            active(0),
+            stopping(false)
+        {
+            threads.reserve(num_threads);
+            for (std::size_t i = 0; i < num_threads; i++) {
+                threads.push_back( std::thread(&WorkerPool::worker, this) );
+            }
+        }
+
+        //
+        // finishes what's queued before stopping the threads
+        WorkerPool::~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            task_queued.notify_all();
+
+            for (std::thread& t : threads) {
+                t.join();
+            }
+        }
+
+
+        //
+        // queue a task or run it now if there are no threads
+        void WorkerPool::run(const Task& task)
+        {
+            if (threads.empty()) {
+                task();
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                task_taken.wait(guard, [&]() { return (tasks.size() < max_queued); });
+                tasks.push_back(task);
+            }
+            task_queued.notify_one();
+        }
+
+
+        //
+        // wait for the queue to drain and the threads to go idle
+        void WorkerPool::wait()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            all_done.wait(guard, [&]() { return (tasks.empty() && active == 0); });
+        }
+
+
+        //
+        // thread loop - runs tasks until the pool is stopped and
+        // the queue is empty
+        void WorkerPool::worker()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            while (true) {
+                task_queued.wait(guard, [&]() { return (stopping || !tasks.empty()); });
+
+                if (tasks.empty()) {
+                    // stopping
+                    break;
+                }
+
+                Task task(std::move(tasks.front()));
+                tasks.pop_front();
+                active++;
+                task_taken.notify_one();
+
+                guard.unlock();
+                task();
+                guard.lock();
+
+                active--;
+                if (tasks.empty() && active == 0) {
+                    all_done.notify_all();
+                }
+            }
+        }
+
+    } // util
+} // namespace
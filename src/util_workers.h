@@ -0,0 +1,77 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pdftoedn
+{
+    namespace util
+    {
+        // ===========================================================
+        // fixed set of threads that run queued tasks in the order
+        // they are added. With no threads, tasks run in the caller
+        // as they are added. The queue holds a few tasks per thread
+        // so callers block instead of piling up work (and the data
+        // it carries) faster than it can be done.
+        //
+        // Tasks must not throw.
+        //
+        class WorkerPool
+        {
+        public:
+            typedef std::function<void()> Task;
+
+            WorkerPool(std::size_t num_threads = 0);
+            ~WorkerPool();
+
+            std::size_t size() const { return threads.size(); }
+
+            // queues a task, waiting for room if the queue is full
+            void run(const Task& task);
+
+            // blocks until all queued tasks have completed
+            void wait();
+
+        private:
+            std::vector<std::thread> threads;
+            std::deque<Task> tasks;
+            std::size_t max_queued;
+            std::size_t active;
+            bool stopping;
+
+            std::mutex lock;
+            std::condition_variable task_queued;
+            std::condition_variable task_taken;
+            std::condition_variable all_done;
+
+            void worker();
+
+            // non-copyable
+            WorkerPool(const WorkerPool&);
+            WorkerPool& operator=(const WorkerPool&);
+        };
+
+    } // util
+} // namespace
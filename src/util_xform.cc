@@ -22,6 +22,7 @@
 
 #include "base_types.h"
 #include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
 #include "util_xform.h"
 
 //#define XFORM_DEBUG
@@ -58,6 +59,8 @@ namespace pdftoedn
             uint8_t transform_image(const PdfTM& image_ctm, std::string& blob,
                                     int& width, int& height, bool inverted_mask)
             {
+                StatsTracker::Timer t(StatsTracker::PHASE_IMAGE_XFORM);
+
                 uint8_t ops = XFORM_NONE;
                 PdfTM ctm(image_ctm);
                 PIX* p = pixReadMemPng(reinterpret_cast<const l_uint8*>(blob.c_str()),
@@ -218,6 +221,37 @@ namespace pdftoedn
 
                 return ops;
             }
+
+            // =======================================================================
+            // decompose the transformation the same way transform_image()
+            // does without touching any image data. Returns false if
+            // it requires an arbitrary rotation
+            //
+            bool orthogonal_orientation(const PdfTM& image_ctm, int& rotation,
+                                        bool& flip_h, bool& flip_v)
+            {
+                PdfTM ctm(image_ctm);
+
+                rotation = 0;
+                if (ctm.is_rotated()) {
+                    double angle_d = std::round( ctm.rotation_deg() );
+
+                    if (angle_d != 90 && angle_d != 180 && angle_d != 270) {
+                        return false;
+                    }
+
+                    rotation = static_cast<int>(angle_d);
+                    ctm = ctm * PdfTM(PdfTM::deg_to_rad(angle_d), 0, 0);
+                }
+
+                flip_h = ctm.is_flipped();
+                if (flip_h) {
+                    ctm.scale(-1, 1);
+                }
+
+                flip_v = ctm.is_upside_down();
+                return true;
+            }
         } // namespace xform
     } // namespace util
 } // namespace
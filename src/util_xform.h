@@ -48,6 +48,8 @@ namespace pdftoedn
             bool init_transform_lib();
             uint8_t transform_image(const PdfTM& ctm, std::string& blob,
                                     int& width, int& height, bool inverted_mask);
+            bool orthogonal_orientation(const PdfTM& ctm, int& rotation,
+                                        bool& flip_h, bool& flip_v);
         }
     }
 }
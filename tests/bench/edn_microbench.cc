@@ -0,0 +1,408 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+//
+// microbenchmarks for the EDN serialization layer. Each case is run
+// with an increasing number of iterations until it takes at least
+// the minimum time, Google Benchmark-style, and reports the time per
+// iteration and output throughput.
+//
+// PdfPage::to_edn is measured on pages of the PDFs passed as
+// arguments (e.g., the synthetic documents in bench/docs): each page
+// is extracted once, then only its serialization is timed.
+//
+#include <string>
+#include <vector>
+#include <list>
+#include <iostream>
+#include <iomanip>
+#include <streambuf>
+#include <functional>
+#include <chrono>
+#include <clocale>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+
+#include <poppler/GlobalParams.h>
+#include <poppler/PDFDoc.h>
+#include <poppler/Error.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "base_types.h"
+#include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
+#include "pdf_output_dev.h"
+#include "font_engine.h"
+#include "doc_page.h"
+#include "runtime_options.h"
+#include "font_maps.h"
+#include "util_edn.h"
+#include "util_xform.h"
+
+namespace pdftoedn {
+
+    // globals normally defined by the pdftoedn executable
+    pdftoedn::ErrorTracker et;
+    pdftoedn::Options options;
+    pdftoedn::DocFontMaps doc_font_maps;
+    pdftoedn::StatsTracker stats;
+
+} // namespace
+
+using namespace pdftoedn;
+namespace edn = pdftoedn::util::edn;
+
+namespace {
+
+    // ======================================================================
+    // an ostream that discards its output but counts the bytes
+    //
+    class CountingBuf : public std::streambuf {
+    public:
+        CountingBuf() : count(0) {}
+        uintmax_t count;
+
+    protected:
+        virtual int_type overflow(int_type c) {
+            count++;
+            return traits_type::not_eof(c);
+        }
+        virtual std::streamsize xsputn(const char*, std::streamsize n) {
+            count += n;
+            return n;
+        }
+    };
+
+    struct NullStream : public std::ostream {
+        NullStream() : std::ostream(&buf) {}
+        uintmax_t bytes() const { return buf.count; }
+        CountingBuf buf;
+    };
+
+
+    // ======================================================================
+    // benchmark state passed to each case - the case loops while
+    // keep_running() returns true and writes to the given stream
+    //
+    class State {
+    public:
+        State(uintmax_t iters) : iterations(iters), remaining(iters) {}
+
+        bool keep_running() {
+            if (remaining == 0) {
+                return false;
+            }
+            remaining--;
+            return true;
+        }
+
+        const uintmax_t iterations;
+        NullStream out;
+
+    private:
+        uintmax_t remaining;
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::function<void (State&)> fn;
+    };
+
+    //
+    // runs the case with a growing iteration count until the minimum
+    // time is reached and reports the last run
+    void run_benchmark(const Benchmark& b, double min_time_s)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        uintmax_t iters = 1;
+        while (true) {
+            State state(iters);
+
+            clock::time_point start = clock::now();
+            b.fn(state);
+            double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+            if (elapsed >= min_time_s || iters >= (1ULL << 32)) {
+                std::cout << std::left << std::setw(44) << b.name << std::right
+                          << std::fixed << std::setprecision(1)
+                          << std::setw(14) << (elapsed * 1e9 / iters) << " ns"
+                          << std::setw(12) << iters
+                          << std::setw(12) << (state.out.bytes() / (1024.0 * 1024.0) / elapsed) << " MB/s"
+                          << std::endl;
+                return;
+            }
+
+            // estimate the iterations needed, growing by 10x at most
+            double mult = (elapsed > 0 ? (min_time_s * 1.4) / elapsed : 10.0);
+            iters = static_cast<uintmax_t>(iters * std::min(std::max(mult, 2.0), 10.0));
+        }
+    }
+
+
+    // ======================================================================
+    // cases
+    //
+    static const Symbol SYMBOL_X    = "x";
+    static const Symbol SYMBOL_Y    = "y";
+    static const Symbol SYMBOL_NAME = "name";
+    static const Symbol SYMBOL_KEYS[] = {
+        "k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7",
+        "k8", "k9", "k10", "k11", "k12", "k13", "k14", "k15",
+    };
+
+    void add_node_benchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        benchmarks.push_back({ "EDNNode/uint", [](State& s) {
+                    while (s.keep_running()) { s.out << edn::EDNNode(static_cast<uintmax_t>(s.iterations)); }
+                } });
+        benchmarks.push_back({ "EDNNode/double", [](State& s) {
+                    double d = 612.0 / 7.0;
+                    while (s.keep_running()) { s.out << edn::EDNNode(d); }
+                } });
+        benchmarks.push_back({ "EDNNode/symbol", [](State& s) {
+                    while (s.keep_running()) { s.out << edn::EDNNode(SYMBOL_NAME); }
+                } });
+        benchmarks.push_back({ "EDNNode/string_lvalue", [](State& s) {
+                    std::string str("a plain ascii span of text");
+                    while (s.keep_running()) { s.out << edn::EDNNode(str); }
+                } });
+        benchmarks.push_back({ "EDNNode/string_char_ptr", [](State& s) {
+                    // allocates a copy of the string
+                    while (s.keep_running()) { s.out << edn::EDNNode("a plain ascii span of text"); }
+                } });
+        benchmarks.push_back({ "EDNNode/string_escaped", [](State& s) {
+                    std::string str("\"quoted\" \\back\\slashed\\ and \"more\" \"quotes\"");
+                    while (s.keep_running()) { s.out << edn::EDNNode(str); }
+                } });
+        benchmarks.push_back({ "EDNNode/string_utf8", [](State& s) {
+                    std::string str("\xc5\x91r\xc3\xbcl \xc5\xb1z \xe4\xb8\x80\xe4\xba\x8c\xe4\xb8\x89 ipsum dolor");
+                    while (s.keep_running()) { s.out << edn::EDNNode(str); }
+                } });
+        benchmarks.push_back({ "EDNNode/string_long", [](State& s) {
+                    std::string str(4096, 'x');
+                    while (s.keep_running()) { s.out << edn::EDNNode(str); }
+                } });
+    }
+
+    void add_container_benchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        benchmarks.push_back({ "Vector/push_64_doubles", [](State& s) {
+                    while (s.keep_running()) {
+                        edn::Vector v(64);
+                        for (uint8_t i = 0; i < 64; i++) { v.push(i * 1.5); }
+                    }
+                } });
+        benchmarks.push_back({ "Vector/push_to_edn_64_doubles", [](State& s) {
+                    while (s.keep_running()) {
+                        edn::Vector v(64);
+                        for (uint8_t i = 0; i < 64; i++) { v.push(i * 1.5); }
+                        s.out << v;
+                    }
+                } });
+        benchmarks.push_back({ "Vector/to_edn_nested_8x8", [](State& s) {
+                    while (s.keep_running()) {
+                        edn::Vector outer(8);
+                        for (uint8_t i = 0; i < 8; i++) {
+                            edn::Vector inner(8);
+                            for (uint8_t j = 0; j < 8; j++) { inner.push(static_cast<uintmax_t>(i * j)); }
+                            outer.push(inner);
+                        }
+                        s.out << outer;
+                    }
+                } });
+        benchmarks.push_back({ "Hash/push_16_pairs", [](State& s) {
+                    while (s.keep_running()) {
+                        edn::Hash h(16);
+                        for (uint8_t i = 0; i < 16; i++) { h.push(SYMBOL_KEYS[i], static_cast<uintmax_t>(i)); }
+                    }
+                } });
+        benchmarks.push_back({ "Hash/push_to_edn_16_pairs", [](State& s) {
+                    while (s.keep_running()) {
+                        edn::Hash h(16);
+                        for (uint8_t i = 0; i < 16; i++) { h.push(SYMBOL_KEYS[i], static_cast<uintmax_t>(i)); }
+                        s.out << h;
+                    }
+                } });
+        benchmarks.push_back({ "Hash/to_edn_mixed_values", [](State& s) {
+                    std::string str("some text");
+                    Coord c(10.5, 20.25);
+                    BoundingBox bbox(10, 20, 300.5, 12.75);
+                    while (s.keep_running()) {
+                        edn::Hash h(6);
+                        h.push( SYMBOL_KEYS[0], str );
+                        h.push( SYMBOL_KEYS[1], c );
+                        h.push( SYMBOL_KEYS[2], bbox );
+                        h.push( SYMBOL_KEYS[3], true );
+                        h.push( SYMBOL_KEYS[4], 12.5 );
+                        h.push( SYMBOL_KEYS[5], SYMBOL_NAME );
+                        s.out << h;
+                    }
+                } });
+    }
+
+    void add_geometry_benchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        benchmarks.push_back({ "Coord/to_edn", [](State& s) {
+                    Coord c(72.125, 711.5);
+                    while (s.keep_running()) { s.out << c; }
+                } });
+        benchmarks.push_back({ "Coord/node_rvalue", [](State& s) {
+                    // copy made by the node
+                    while (s.keep_running()) { s.out << edn::EDNNode(Coord(72.125, 711.5)); }
+                } });
+        benchmarks.push_back({ "BoundingBox/to_edn", [](State& s) {
+                    BoundingBox b(72.125, 711.5, 451.25, 9.75);
+                    while (s.keep_running()) { s.out << b; }
+                } });
+        benchmarks.push_back({ "BoundingBox/node_rvalue", [](State& s) {
+                    while (s.keep_running()) { s.out << edn::EDNNode(BoundingBox(72.125, 711.5, 451.25, 9.75)); }
+                } });
+    }
+
+
+    // ======================================================================
+    // pages extracted from a document using the regular output device
+    //
+    struct DocPages {
+        PDFDoc* doc;
+        FontEngine* font_engine;
+        std::list<pdftoedn::OutputDev*> devs;   // each one owns a page
+
+        DocPages() : doc(nullptr), font_engine(nullptr) {}
+        ~DocPages() {
+            for (pdftoedn::OutputDev* d : devs) { delete d; }
+            delete font_engine;
+            delete doc;
+        }
+    };
+
+    bool extract_pages(const std::string& pdf, DocPages& pages, uintmax_t max_pages)
+    {
+        namespace fs = boost::filesystem;
+
+        pdftoedn::Options::Flags flags = { false };
+        flags.edn_output_only = true; // don't write images
+        flags.force_output_write = true;
+
+        fs::path edn_file = fs::temp_directory_path() / fs::unique_path("pdftoedn-edn-bench-%%%%-%%%%.edn");
+        pdftoedn::options = pdftoedn::Options(pdf, "", "", edn_file.string(), "", flags, -1);
+
+        pages.doc = new PDFDoc(new GooString(pdf.c_str()), nullptr, nullptr);
+        if (!pages.doc->isOk()) {
+            std::cerr << pdf << ": unable to open document" << std::endl;
+            return false;
+        }
+        pages.font_engine = new FontEngine(pages.doc->getXRef());
+
+        uintmax_t num_pages = std::min<uintmax_t>(pages.doc->getNumPages(), max_pages);
+        for (uintmax_t p = 1; p <= num_pages; p++) {
+            pdftoedn::OutputDev* dev = new pdftoedn::OutputDev(pages.doc->getCatalog(), *pages.font_engine);
+            pages.doc->displayPage(dev, p, 72.0, 72.0, 0, false, true, false);
+            pages.devs.push_back(dev);
+        }
+        return true;
+    }
+
+    void add_page_benchmarks(std::vector<Benchmark>& benchmarks, const std::list<DocPages*>& docs,
+                             const std::vector<std::string>& names)
+    {
+        uintmax_t i = 0;
+        for (const DocPages* d : docs) {
+            const DocPages* pages = d;
+            benchmarks.push_back({ "PdfPage/to_edn/" + names[i++], [pages](State& s) {
+                        while (s.keep_running()) {
+                            for (const pdftoedn::OutputDev* dev : pages->devs) {
+                                if (dev->page_data()) {
+                                    s.out << *dev->page_data();
+                                }
+                            }
+                        }
+                    } });
+        }
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    std::setlocale(LC_ALL, "");
+
+    double min_time_s = 0.5;
+    std::string filter;
+    std::vector<std::string> pdfs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--min_time" && i + 1 < argc) {
+            min_time_s = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            std::cerr << "usage: " << argv[0] << " [--min_time <secs>] [--filter <substr>] [doc.pdf ...]" << std::endl;
+            return 0;
+        } else {
+            pdfs.push_back(arg);
+        }
+    }
+
+    pdftoedn::util::xform::init_transform_lib();
+    globalParams = new GlobalParams();
+    setErrorCallback(&pdftoedn::ErrorTracker::error_handler, &pdftoedn::et);
+
+    std::vector<Benchmark> benchmarks;
+    add_node_benchmarks(benchmarks);
+    add_container_benchmarks(benchmarks);
+    add_geometry_benchmarks(benchmarks);
+
+    // extract the pages up front
+    std::list<DocPages*> docs;
+    std::vector<std::string> names;
+    for (const std::string& pdf : pdfs) {
+        DocPages* pages = new DocPages;
+        try {
+            if (extract_pages(pdf, *pages, 20)) {
+                docs.push_back(pages);
+                names.push_back(boost::filesystem::path(pdf).filename().string());
+                continue;
+            }
+        } catch (std::exception& e) {
+            std::cerr << pdf << ": " << e.what() << std::endl;
+        }
+        delete pages;
+    }
+    add_page_benchmarks(benchmarks, docs, names);
+
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right
+              << std::setw(17) << "time/iter" << std::setw(12) << "iters"
+              << std::setw(17) << "output" << std::endl;
+
+    for (const Benchmark& b : benchmarks) {
+        if (filter.empty() || b.name.find(filter) != std::string::npos) {
+            run_benchmark(b, min_time_s);
+        }
+    }
+
+    for (DocPages* d : docs) { delete d; }
+    delete globalParams;
+    return 0;
+}
@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+#
+# Generates the synthetic documents in bench/docs used by the
+# benchmark corpus to cover cases not present in tests/docs:
+#
+#   bench_vector.pdf - pages with thousands of stroked, filled and
+#                      clipped paths
+#   bench_images.pdf - repeated, transformed, masked and inlined
+#                      images
+#   bench_cid.pdf    - text set with a Type0 (CID) font using
+#                      Identity-H and a ToUnicode CMap
+#
+# Output is deterministic so the generated files are checked in;
+# re-run only if the generator changes:
+#
+#   python3 make_bench_docs.py docs
+#
+import os
+import sys
+import zlib
+
+
+class Lcg:
+    """small deterministic PRNG so output doesn't depend on python's"""
+    def __init__(self, seed):
+        self.state = seed
+
+    def next(self):
+        self.state = (self.state * 1103515245 + 12345) & 0x7fffffff
+        return self.state
+
+    def uniform(self, lo, hi):
+        return lo + (hi - lo) * (self.next() / float(0x7fffffff))
+
+
+class PdfWriter:
+    def __init__(self):
+        self.objects = []
+
+    def reserve(self):
+        self.objects.append(None)
+        return len(self.objects)
+
+    def set(self, num, body):
+        self.objects[num - 1] = body
+
+    def add(self, body):
+        num = self.reserve()
+        self.set(num, body)
+        return num
+
+    @staticmethod
+    def stream(dict_entries, data, compress=True):
+        if compress:
+            data = zlib.compress(data, 9)
+            dict_entries += b" /Filter /FlateDecode"
+        return (b"<< " + dict_entries + b" /Length " + str(len(data)).encode() +
+                b" >>\nstream\n" + data + b"\nendstream")
+
+    def write(self, filename, root):
+        out = bytearray(b"%PDF-1.4\n%\xe2\xe3\xcf\xd3\n")
+        offsets = []
+        for i, body in enumerate(self.objects):
+            offsets.append(len(out))
+            out += str(i + 1).encode() + b" 0 obj\n" + body + b"\nendobj\n"
+        xref = len(out)
+        out += b"xref\n0 " + str(len(self.objects) + 1).encode() + b"\n"
+        out += b"0000000000 65535 f \n"
+        for off in offsets:
+            out += b"%010d 00000 n \n" % off
+        out += (b"trailer\n<< /Size " + str(len(self.objects) + 1).encode() +
+                b" /Root " + str(root).encode() + b" 0 R >>\nstartxref\n" +
+                str(xref).encode() + b"\n%%EOF\n")
+        with open(filename, "wb") as f:
+            f.write(out)
+
+
+def add_pages(pdf, contents, resources):
+    pages_num = pdf.reserve()
+    kids = []
+    for content in contents:
+        content_num = pdf.add(PdfWriter.stream(b"", content))
+        kids.append(pdf.add(b"<< /Type /Page /Parent " + str(pages_num).encode() +
+                            b" 0 R /MediaBox [0 0 612 792] /Resources " + resources +
+                            b" /Contents " + str(content_num).encode() + b" 0 R >>"))
+    pdf.set(pages_num, b"<< /Type /Pages /Count " + str(len(kids)).encode() +
+            b" /Kids [" + b" ".join(str(k).encode() + b" 0 R" for k in kids) + b"] >>")
+    return pdf.add(b"<< /Type /Catalog /Pages " + str(pages_num).encode() + b" 0 R >>")
+
+
+def fmt(*vals):
+    return " ".join("%.2f" % v for v in vals)
+
+
+# ----------------------------------------------------------------------
+def vector_doc(filename):
+    rnd = Lcg(23822)
+    pdf = PdfWriter()
+    contents = []
+    for page in range(4):
+        ops = []
+        # a few clip regions per page
+        for clip in range(4):
+            x, y = 20 + (clip % 2) * 290, 20 + (clip // 2) * 380
+            ops.append("q %s re W n" % fmt(x, y, 280, 370))
+            for i in range(500):
+                ops.append("%s RG %s rg %.2f w" % (fmt(rnd.uniform(0, 1), rnd.uniform(0, 1), rnd.uniform(0, 1)),
+                                                  fmt(rnd.uniform(0, 1), rnd.uniform(0, 1), rnd.uniform(0, 1)),
+                                                  rnd.uniform(0.1, 3)))
+                if i % 7 == 0:
+                    ops.append("[%d %d] 0 d" % (1 + i % 5, 1 + i % 3))
+                elif i % 7 == 1:
+                    ops.append("[] 0 d")
+                x0, y0 = rnd.uniform(0, 612), rnd.uniform(0, 792)
+                ops.append("%s m" % fmt(x0, y0))
+                for seg in range(1 + i % 6):
+                    if seg % 2:
+                        ops.append("%s c" % fmt(*[rnd.uniform(0, 612) if k % 2 == 0 else rnd.uniform(0, 792)
+                                                  for k in range(6)]))
+                    else:
+                        ops.append("%s l" % fmt(rnd.uniform(0, 612), rnd.uniform(0, 792)))
+                ops.append(["S", "f", "B", "h S", "f*"][i % 5])
+            ops.append("Q")
+        contents.append("\n".join(ops).encode())
+    root = add_pages(pdf, contents, b"<< >>")
+    pdf.write(filename, root)
+
+
+# ----------------------------------------------------------------------
+def image_data(width, height, comps, seed):
+    rnd = Lcg(seed)
+    rows = bytearray()
+    for y in range(height):
+        for x in range(width):
+            for c in range(comps):
+                v = (((x // 4) * (c + 1) + (y // 4) * (3 - c)) * 2 + seed * 17) & 0xff
+                # sprinkle a little noise on blocks
+                if ((x // 16) + (y // 16)) % 13 == 0:
+                    v = (v + rnd.next()) & 0xff
+                rows.append(v)
+    return bytes(rows)
+
+
+def image_xobject(pdf, width, height, comps, seed, extra=b""):
+    cs = {1: b"/DeviceGray", 3: b"/DeviceRGB"}[comps]
+    return pdf.add(PdfWriter.stream(b"/Type /XObject /Subtype /Image /Width " + str(width).encode() +
+                                    b" /Height " + str(height).encode() + b" /ColorSpace " + cs +
+                                    b" /BitsPerComponent 8" + extra,
+                                    image_data(width, height, comps, seed)))
+
+
+def images_doc(filename):
+    pdf = PdfWriter()
+
+    smask = image_xobject(pdf, 240, 180, 1, 5)
+    mask_bits = bytes(((x * 7 + y * 3) & 0xff) for y in range(128) for x in range(16))
+    imgs = {
+        b"Im1": image_xobject(pdf, 400, 300, 3, 1),
+        b"Im2": image_xobject(pdf, 300, 200, 3, 2),
+        b"Im3": image_xobject(pdf, 256, 256, 1, 3),
+        b"Im4": image_xobject(pdf, 240, 180, 3, 4, b" /SMask " + str(smask).encode() + b" 0 R"),
+        b"Mk1": pdf.add(PdfWriter.stream(b"/Type /XObject /Subtype /Image /Width 128 /Height 128"
+                                         b" /ImageMask true /BitsPerComponent 1 /Decode [1 0]", mask_bits)),
+    }
+    resources = (b"<< /XObject << " +
+                 b" ".join(b"/" + k + b" " + str(v).encode() + b" 0 R" for k, v in sorted(imgs.items())) +
+                 b" >> >>")
+
+    # hex-encoded so the data can't contain a stray EI
+    inline = (b"BI /W 16 /H 16 /CS /RGB /BPC 8 /F /AHx ID\n" +
+              image_data(16, 16, 3, 9).hex().encode() + b">\nEI")
+
+    contents = []
+    for page in range(5):
+        ops = [
+            # straight draw and a repeat of the same object (cache hit)
+            "q 240 0 0 180 30 580 cm /Im1 Do Q",
+            "q 120 0 0 90 300 600 cm /Im1 Do Q",
+            # rotated and flipped images exercise the transforms
+            "q 0 180 -240 0 300 380 cm /Im2 Do Q",
+            "q 160 0 0 -160 330 560 cm /Im3 Do Q",
+            # soft-masked and stencil-masked images
+            "q 240 0 0 180 30 150 cm /Im4 Do Q",
+            "q 0.8 0.1 0.1 rg 128 0 0 128 330 180 cm /Mk1 Do Q",
+            "q %d 0 0 64 460 40 cm /Mk1 Do Q" % (64 + page * 8),
+        ]
+        content = "\n".join(ops).encode()
+        # same inlined image used twice to hit the md5 cache
+        for pos in ((40, 40), (120, 40)):
+            content += ("\nq 48 0 0 48 %d %d cm\n" % pos).encode() + inline + b"\nQ"
+        contents.append(content)
+
+    root = add_pages(pdf, contents, resources)
+    pdf.write(filename, root)
+
+
+# ----------------------------------------------------------------------
+def cid_doc(filename):
+    pdf = PdfWriter()
+
+    cmap = b"""/CIDInit /ProcSet findresource begin
+12 dict begin
+begincmap
+/CIDSystemInfo << /Registry (Adobe) /Ordering (UCS) /Supplement 0 >> def
+/CMapName /Adobe-Identity-UCS def
+/CMapType 2 def
+1 begincodespacerange
+<0000> <FFFF>
+endcodespacerange
+3 beginbfrange
+<0020> <007E> <0020>
+<0100> <017F> <0100>
+<4E00> <4EFF> <4E00>
+endbfrange
+endcmap
+CMapName currentdict /CMap defineresource pop
+end
+end"""
+    tounicode = pdf.add(PdfWriter.stream(b"", cmap))
+    descriptor = pdf.add(b"<< /Type /FontDescriptor /FontName /ArialUnicodeMS /Flags 32"
+                         b" /FontBBox [-1011 -330 2260 1078] /ItalicAngle 0 /Ascent 1069"
+                         b" /Descent -271 /CapHeight 716 /StemV 80 >>")
+    cidfont = pdf.add(b"<< /Type /Font /Subtype /CIDFontType2 /BaseFont /ArialUnicodeMS"
+                      b" /CIDSystemInfo << /Registry (Adobe) /Ordering (Identity) /Supplement 0 >>"
+                      b" /FontDescriptor " + str(descriptor).encode() + b" 0 R /DW 1000"
+                      b" /W [32 [278 278 355 556 556 889 667 191 333 333 389 584 278 333 278 278]"
+                      b" 48 57 556 65 90 667 97 122 556] >>")
+    font = pdf.add(b"<< /Type /Font /Subtype /Type0 /BaseFont /ArialUnicodeMS /Encoding /Identity-H"
+                   b" /DescendantFonts [" + str(cidfont).encode() + b" 0 R] /ToUnicode " +
+                   str(tounicode).encode() + b" 0 R >>")
+    resources = b"<< /Font << /F1 " + str(font).encode() + b" 0 R >> >>"
+
+    words = ["lorem", "ipsum", "dolor", "sit", "amet", "őrül", "űz", "ősz",
+             "一二三", "中上", "consectetur", "adipiscing", "elit"]
+    rnd = Lcg(4)
+    contents = []
+    for page in range(8):
+        ops = ["BT /F1 9 Tf 11 TL 36 756 Td"]
+        for line in range(64):
+            text = " ".join(words[rnd.next() % len(words)] for w in range(12))
+            codes = "".join("%04X" % ord(ch) for ch in text)
+            ops.append("<%s> Tj T*" % codes)
+        ops.append("ET")
+        contents.append("\n".join(ops).encode())
+
+    root = add_pages(pdf, contents, resources)
+    pdf.write(filename, root)
+
+
+if __name__ == "__main__":
+    out_dir = sys.argv[1] if len(sys.argv) > 1 else "docs"
+    vector_doc(os.path.join(out_dir, "bench_vector.pdf"))
+    images_doc(os.path.join(out_dir, "bench_images.pdf"))
+    cid_doc(os.path.join(out_dir, "bench_cid.pdf"))
@@ -0,0 +1,612 @@
+//
+// Copyright 2016-2019 Ed Porras
+//
+// This file is part of pdftoedn.
+//
+// pdftoedn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// pdftoedn is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with pdftoedn.  If not, see <http://www.gnu.org/licenses/>.
+
+//
+// benchmark driver - runs the extractor in-process over the
+// documents listed in a corpus file and reports throughput, peak
+// memory use and per-phase times. Each document is processed in a
+// forked child so peak RSS is measured per document and global state
+// (font maps, poppler's globalParams, etc.) doesn't carry over.
+// Results can be saved as a baseline and later runs compared
+// against it.
+//
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <poppler/GlobalParams.h>
+#include <poppler/Error.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "pdf_error_tracker.h"
+#include "pdf_stats_tracker.h"
+#include "pdf_reader.h"
+#include "runtime_options.h"
+#include "font_maps.h"
+#include "util_output.h"
+#include "util_xform.h"
+
+namespace pdftoedn {
+
+    // globals normally defined by the pdftoedn executable
+    pdftoedn::ErrorTracker et;
+    pdftoedn::Options options;
+    pdftoedn::DocFontMaps doc_font_maps;
+    pdftoedn::StatsTracker stats;
+
+} // namespace
+
+namespace fs = boost::filesystem;
+using pdftoedn::StatsTracker;
+
+// limits for --image_workers and --output_buffer_size, as in pdftoedn
+static const uintmax_t MAX_IMAGE_WORKERS = 64;
+static const uintmax_t MIN_OUTPUT_BUFFER_KB = 4;
+static const uintmax_t MAX_OUTPUT_BUFFER_KB = 64 * 1024;
+
+namespace {
+
+    // ======================================================================
+    // a document to process as listed in the corpus file
+    //
+    struct CorpusEntry {
+        std::string name;       // as listed in the corpus - used as baseline key
+        std::string doc_case;   // text, vector, image, etc.
+        std::string pdf;
+        std::string font_map;
+        std::string user_password;
+        std::string owner_password;
+        intmax_t page_num;
+
+        CorpusEntry() : page_num(-1) {}
+    };
+
+    //
+    // results for one document. Phase times are per run averages
+    struct Result {
+        bool ok;
+        uintmax_t runs;
+        uintmax_t pages;
+        uintmax_t edn_bytes;
+        double wall_ms;         // median
+        double phase_ms[StatsTracker::PHASE_TYPE_COUNT];
+        double peak_rss_mb;
+
+        Result() : ok(false), runs(0), pages(0), edn_bytes(0), wall_ms(0), peak_rss_mb(0) {
+            std::fill(phase_ms, phase_ms + StatsTracker::PHASE_TYPE_COUNT, 0);
+        }
+
+        double pages_per_sec() const { return (wall_ms > 0 ? pages / (wall_ms / 1000.0) : 0); }
+        double edn_mb_per_sec() const {
+            return (wall_ms > 0 ? (edn_bytes / (1024.0 * 1024.0)) / (wall_ms / 1000.0) : 0);
+        }
+    };
+
+    //
+    // extractor settings applied to every document
+    struct RunConfig {
+        pdftoedn::Options::Settings settings;
+        uintmax_t output_buffer_kb;
+        std::string compress_spec;
+
+        RunConfig() : output_buffer_kb(pdftoedn::util::output::Sink::DEFAULT_BUFFER_SIZE / 1024) {}
+
+        // output is written the way pdftoedn does
+        pdftoedn::util::output::Sink* make_sink() const {
+            pdftoedn::util::output::Sink* sink = new pdftoedn::util::output::Sink(output_buffer_kb * 1024);
+            if (!compress_spec.empty()) {
+                sink->set_compressor(pdftoedn::util::output::Compressor::create(compress_spec));
+            }
+            return sink;
+        }
+    };
+
+    //
+    // baseline values per document
+    struct Baseline {
+        double pages_per_sec;
+        double edn_mb_per_sec;
+        double peak_rss_mb;
+    };
+
+
+    // ======================================================================
+    // corpus file parsing
+    //
+    bool read_corpus(const std::string& corpus_file, std::vector<CorpusEntry>& corpus)
+    {
+        std::ifstream f(corpus_file.c_str());
+        if (!f.is_open()) {
+            std::cerr << "Unable to open corpus file " << corpus_file << std::endl;
+            return false;
+        }
+
+        // paths are relative to the corpus file
+        fs::path base = fs::path(corpus_file).parent_path();
+
+        std::string line;
+        uintmax_t line_num = 0;
+        while (std::getline(f, line))
+        {
+            line_num++;
+
+            std::istringstream ss(line);
+            CorpusEntry entry;
+            if (!(ss >> entry.doc_case) || entry.doc_case[0] == '#') {
+                continue;
+            }
+            if (!(ss >> entry.name)) {
+                std::cerr << corpus_file << ":" << line_num << ": missing document" << std::endl;
+                return false;
+            }
+            entry.pdf = (base / entry.name).string();
+
+            std::string opt;
+            while (ss >> opt) {
+                std::string val;
+                if (!(ss >> val)) {
+                    std::cerr << corpus_file << ":" << line_num << ": missing value for " << opt << std::endl;
+                    return false;
+                }
+
+                if (opt == "-m")      { entry.font_map = (base / val).string(); }
+                else if (opt == "-u") { entry.user_password = val; }
+                else if (opt == "-t") { entry.owner_password = val; }
+                else if (opt == "-p") { entry.page_num = std::strtoll(val.c_str(), nullptr, 10); }
+                else {
+                    std::cerr << corpus_file << ":" << line_num << ": unsupported option " << opt << std::endl;
+                    return false;
+                }
+            }
+            corpus.push_back(entry);
+        }
+        return true;
+    }
+
+
+    // ======================================================================
+    // baseline I/O. One line per document:
+    //
+    //   <name> <pages/s> <EDN MB/s> <peak RSS MB>
+    //
+    bool read_baseline(const std::string& baseline_file, std::map<std::string, Baseline>& baseline)
+    {
+        std::ifstream f(baseline_file.c_str());
+        if (!f.is_open()) {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(f, line)) {
+            std::istringstream ss(line);
+            std::string name;
+            Baseline b;
+            if (!(ss >> name) || name[0] == '#') {
+                continue;
+            }
+            if (ss >> b.pages_per_sec >> b.edn_mb_per_sec >> b.peak_rss_mb) {
+                baseline[name] = b;
+            }
+        }
+        return true;
+    }
+
+    bool write_baseline(const std::string& baseline_file,
+                        const std::vector<CorpusEntry>& corpus, const std::vector<Result>& results)
+    {
+        std::ofstream f(baseline_file.c_str());
+        if (!f.is_open()) {
+            std::cerr << "Unable to open baseline file " << baseline_file << " for write" << std::endl;
+            return false;
+        }
+
+        f << "# pdftoedn benchmark baseline" << std::endl
+          << "# <document> <pages/s> <EDN MB/s> <peak RSS MB>" << std::endl;
+        for (uintmax_t i = 0; i < corpus.size(); i++) {
+            if (results[i].ok) {
+                f << corpus[i].name << " "
+                  << results[i].pages_per_sec() << " "
+                  << results[i].edn_mb_per_sec() << " "
+                  << results[i].peak_rss_mb << std::endl;
+            }
+        }
+        return true;
+    }
+
+
+    // ======================================================================
+    // document processing - runs in the child process
+    //
+    bool process_document(const CorpusEntry& entry, const RunConfig& config, const fs::path& work_dir,
+                          uintmax_t& pages, uintmax_t& edn_bytes, double& wall_ms,
+                          double* phase_ms)
+    {
+        fs::path edn_file = work_dir / fs::path(entry.pdf).stem();
+        edn_file.replace_extension(".edn");
+
+        pdftoedn::Options::Flags flags = { false };
+        flags.force_output_write = true;
+        flags.collect_stats = true;
+
+        pdftoedn::options = pdftoedn::Options(entry.pdf,
+                                              entry.owner_password, entry.user_password,
+                                              edn_file.string(), entry.font_map,
+                                              flags, entry.page_num, config.settings);
+
+        pdftoedn::stats.reset();
+        pdftoedn::stats.enable();
+
+        StatsTracker::clock::time_point start = StatsTracker::clock::now();
+        {
+            pdftoedn::PDFReader doc_reader;
+
+            std::unique_ptr<pdftoedn::util::output::Sink> sink(config.make_sink());
+            if (!sink->open(edn_file.string())) {
+                std::cerr << edn_file << ": cannot open file for write" << std::endl;
+                return false;
+            }
+
+            std::ostream output(sink.get());
+            output << doc_reader;
+
+            // count the EDN produced, before any compression
+            edn_bytes = output.tellp();
+
+            if (!sink->close()) {
+                std::cerr << edn_file << ": error writing output" << std::endl;
+                return false;
+            }
+        }
+        wall_ms = std::chrono::duration<double, std::milli>(StatsTracker::clock::now() - start).count();
+
+        pages = pdftoedn::stats.num_pages();
+
+        for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+            phase_ms[p] = std::chrono::duration<double, std::milli>(
+                pdftoedn::stats.total_time(static_cast<StatsTracker::phase_type>(p))).count();
+        }
+
+        // remove the output so images are written again on the next
+        // run
+        fs::remove(edn_file);
+        fs::remove_all(work_dir / fs::path(entry.pdf).stem());
+        return true;
+    }
+
+    //
+    // runs the document the requested number of times and writes the
+    // result as a line of text to the given fd:
+    //
+    //   <pages> <edn bytes> <median wall ms> <phase ms>...
+    //
+    int run_document(const CorpusEntry& entry, const RunConfig& config, const fs::path& work_dir,
+                     uintmax_t warmup, uintmax_t runs, int out_fd)
+    {
+        std::setlocale(LC_ALL, "");
+        pdftoedn::util::xform::init_transform_lib();
+        globalParams = new GlobalParams();
+        setErrorCallback(&pdftoedn::ErrorTracker::error_handler, &pdftoedn::et);
+
+        uintmax_t pages = 0, edn_bytes = 0;
+        std::vector<double> wall_times;
+        double phase_ms[StatsTracker::PHASE_TYPE_COUNT] = { 0 };
+
+        try
+        {
+            for (uintmax_t i = 0; i < warmup + runs; i++) {
+                double wall_ms;
+                double run_phase_ms[StatsTracker::PHASE_TYPE_COUNT];
+
+                if (!process_document(entry, config, work_dir, pages, edn_bytes, wall_ms, run_phase_ms)) {
+                    return 1;
+                }
+
+                if (i >= warmup) {
+                    wall_times.push_back(wall_ms);
+                    for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+                        phase_ms[p] += run_phase_ms[p] / runs;
+                    }
+                }
+            }
+        } catch (std::exception& e) {
+            std::cerr << entry.name << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        std::sort(wall_times.begin(), wall_times.end());
+
+        std::ostringstream result;
+        result << pages << " " << edn_bytes << " " << wall_times[wall_times.size() / 2];
+        for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+            result << " " << phase_ms[p];
+        }
+        result << std::endl;
+
+        const std::string& r = result.str();
+        return (write(out_fd, r.c_str(), r.length()) == static_cast<ssize_t>(r.length()) ? 0 : 1);
+    }
+
+    //
+    // forks a child to process the document and collects its results
+    // and peak memory use
+    bool run_isolated(const CorpusEntry& entry, const RunConfig& config, const fs::path& work_dir,
+                      uintmax_t warmup, uintmax_t runs, Result& result)
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            std::cerr << "pipe() failed" << std::endl;
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "fork() failed" << std::endl;
+            return false;
+        }
+
+        if (pid == 0) {
+            close(fds[0]);
+            int status = run_document(entry, config, work_dir, warmup, runs, fds[1]);
+            close(fds[1]);
+            _exit(status);
+        }
+
+        close(fds[1]);
+
+        std::string output;
+        char buf[256];
+        ssize_t len;
+        while ((len = read(fds[0], buf, sizeof(buf))) > 0) {
+            output.append(buf, len);
+        }
+        close(fds[0]);
+
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return false;
+        }
+
+        std::istringstream ss(output);
+        if (!(ss >> result.pages >> result.edn_bytes >> result.wall_ms)) {
+            return false;
+        }
+        for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+            ss >> result.phase_ms[p];
+        }
+
+#ifdef __APPLE__
+        // reported in bytes
+        result.peak_rss_mb = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        // reported in kilobytes
+        result.peak_rss_mb = usage.ru_maxrss / 1024.0;
+#endif
+        result.runs = runs;
+        result.ok = true;
+        return true;
+    }
+
+
+    // ======================================================================
+    // reporting
+    //
+    void print_header(std::ostream& o)
+    {
+        o << std::left << std::setw(10) << "case" << std::setw(36) << "document"
+          << std::right << std::setw(6) << "pages"
+          << std::setw(10) << "pages/s" << std::setw(10) << "EDN MB/s" << std::setw(10) << "RSS MB";
+        for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+            o << std::setw(14) << StatsTracker::SYMBOL_PHASES[p].name();
+        }
+        o << std::endl;
+    }
+
+    void print_result(std::ostream& o, const CorpusEntry& entry, const Result& r)
+    {
+        o << std::left << std::setw(10) << entry.doc_case << std::setw(36) << fs::path(entry.name).filename().string()
+          << std::right;
+        if (!r.ok) {
+            o << "  FAILED" << std::endl;
+            return;
+        }
+
+        o << std::fixed << std::setprecision(2)
+          << std::setw(6) << r.pages
+          << std::setw(10) << r.pages_per_sec()
+          << std::setw(10) << r.edn_mb_per_sec()
+          << std::setw(10) << r.peak_rss_mb;
+        for (uint8_t p = 0; p < StatsTracker::PHASE_TYPE_COUNT; p++) {
+            o << std::setw(14) << r.phase_ms[p];
+        }
+        o << std::endl;
+    }
+
+    //
+    // compares a result against its baseline. Throughput may not drop
+    // and peak memory may not grow by more than the threshold
+    bool check_regression(std::ostream& o, const CorpusEntry& entry, const Result& r,
+                          const Baseline& b, double threshold)
+    {
+        bool regressed = false;
+        double drop = 1.0 - threshold / 100.0;
+        double growth = 1.0 + threshold / 100.0;
+
+        if (r.pages_per_sec() < b.pages_per_sec * drop) {
+            o << "  REGRESSION " << entry.name << ": " << r.pages_per_sec()
+              << " pages/s (baseline " << b.pages_per_sec << ")" << std::endl;
+            regressed = true;
+        }
+        if (r.edn_mb_per_sec() < b.edn_mb_per_sec * drop) {
+            o << "  REGRESSION " << entry.name << ": " << r.edn_mb_per_sec()
+              << " EDN MB/s (baseline " << b.edn_mb_per_sec << ")" << std::endl;
+            regressed = true;
+        }
+        if (r.peak_rss_mb > b.peak_rss_mb * growth) {
+            o << "  REGRESSION " << entry.name << ": " << r.peak_rss_mb
+              << " MB peak RSS (baseline " << b.peak_rss_mb << ")" << std::endl;
+            regressed = true;
+        }
+        return regressed;
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    std::string corpus_file, baseline_file;
+    uintmax_t runs = 3, warmup = 1;
+    double threshold = 10.0;
+    bool save_baseline = false;
+
+    // same defaults as pdftoedn
+    RunConfig config;
+    config.settings.image_workers = std::min<uintmax_t>(std::thread::hardware_concurrency(), MAX_IMAGE_WORKERS);
+
+    try
+    {
+        namespace po = boost::program_options;
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h",
+             "Display this message.")
+            ("corpus,c",        po::value<std::string>(&corpus_file)->required(),
+             "Corpus file listing the documents to process.")
+            ("runs,n",          po::value<uintmax_t>(&runs),
+             "Measured runs per document (median is reported). Default: 3.")
+            ("warmup,w",        po::value<uintmax_t>(&warmup),
+             "Unmeasured runs per document. Default: 1.")
+            ("baseline,b",      po::value<std::string>(&baseline_file),
+             "Baseline file to compare results against.")
+            ("save_baseline,s", po::bool_switch(&save_baseline),
+             "Write the results to the baseline file instead of comparing.")
+            ("threshold,t",     po::value<double>(&threshold),
+             "Allowed regression against the baseline, in percent. Default: 10.")
+            ("image_workers",   po::value<uintmax_t>(&config.settings.image_workers),
+             "Number of threads used to encode and write images. Default: the number of CPU cores.")
+            ("output_buffer_size", po::value<uintmax_t>(&config.output_buffer_kb),
+             "Size (in KB) of the buffer used to write output. Default: 1024.")
+            ("compress",        po::value<std::string>(&config.compress_spec),
+             "Compress the output using the given format ('gzip' or 'zstd') and optional level (e.g., 'zstd:19').")
+            ;
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help")) {
+            std::cerr << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+
+        if (runs == 0) {
+            throw std::logic_error("At least one measured run is required.");
+        }
+        if (config.settings.image_workers > MAX_IMAGE_WORKERS) {
+            std::stringstream err;
+            err << "Number of image workers must be between 0 and " << MAX_IMAGE_WORKERS << ".";
+            throw std::logic_error(err.str());
+        }
+        if (config.output_buffer_kb < MIN_OUTPUT_BUFFER_KB || config.output_buffer_kb > MAX_OUTPUT_BUFFER_KB) {
+            std::stringstream err;
+            err << "Output buffer size must be between " << MIN_OUTPUT_BUFFER_KB
+                << " and " << MAX_OUTPUT_BUFFER_KB << " KB.";
+            throw std::logic_error(err.str());
+        }
+        if (!config.compress_spec.empty()) {
+            // throws if the format or level are not valid
+            std::unique_ptr<pdftoedn::util::output::Compressor> c(pdftoedn::util::output::Compressor::create(config.compress_spec));
+        }
+        if (save_baseline && baseline_file.empty()) {
+            throw std::logic_error("A baseline file is required to save results.");
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << "Argument error: " << e.what() << std::endl;
+        return 2;
+    }
+
+    std::vector<CorpusEntry> corpus;
+    if (!read_corpus(corpus_file, corpus)) {
+        return 2;
+    }
+
+    std::map<std::string, Baseline> baseline;
+    if (!save_baseline && !baseline_file.empty() && !read_baseline(baseline_file, baseline)) {
+        std::cerr << "No baseline found at " << baseline_file << " - not checking for regressions" << std::endl;
+    }
+
+    // documents write their output to a scratch directory
+    fs::path work_dir = fs::temp_directory_path() / fs::unique_path("pdftoedn-bench-%%%%-%%%%");
+    fs::create_directories(work_dir);
+
+    std::cout << "runs: " << runs << " (+" << warmup << " warmup), image workers: "
+              << config.settings.image_workers << ", output buffer: " << config.output_buffer_kb << " KB"
+              << (config.compress_spec.empty() ? "" : ", compress: " + config.compress_spec)
+              << ", phase times in ms per run" << std::endl;
+    print_header(std::cout);
+
+    std::vector<Result> results(corpus.size());
+    bool failed = false;
+    for (uintmax_t i = 0; i < corpus.size(); i++) {
+        if (!run_isolated(corpus[i], config, work_dir, warmup, runs, results[i])) {
+            failed = true;
+        }
+        print_result(std::cout, corpus[i], results[i]);
+    }
+
+    fs::remove_all(work_dir);
+
+    if (save_baseline) {
+        return (write_baseline(baseline_file, corpus, results) && !failed ? 0 : 2);
+    }
+
+    bool regressed = false;
+    for (uintmax_t i = 0; i < corpus.size(); i++) {
+        auto b = baseline.find(corpus[i].name);
+        if (results[i].ok && b != baseline.end()) {
+            regressed |= check_regression(std::cout, corpus[i], results[i], b->second, threshold);
+        }
+    }
+
+    if (failed) {
+        return 2;
+    }
+    return (regressed ? 1 : 0);
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+EXPECTED_SUBSTR="Unsupported compression format"
+
+test_start
+
+# only gzip and zstd compression are supported
+run_cmd "$PDFTOEDN --compress bzip2 -o "$TMPFILE" "$TESTDOC""
+status=$?
+
+test_end
+
+flag_set $status $CODE_INIT_ERROR && \
+    check_stdout "$EXPECTED_SUBSTR" && \
+    exit 0
+
+echo "unexpected return value $status"
+exit $status
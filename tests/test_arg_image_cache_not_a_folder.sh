@@ -0,0 +1,21 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+EXPECTED_SUBSTR="image cache folder can't be created"
+
+test_start
+
+# the image cache must be a folder
+run_cmd "$PDFTOEDN --image_cache "$TESTDOC" -o "$TMPFILE" "$TESTDOC""
+status=$?
+
+test_end
+
+flag_set $status $CODE_INIT_ERROR && \
+    check_stdout "$EXPECTED_SUBSTR" && \
+    exit 0
+
+echo "unexpected return value $status"
+exit $status
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+EXPECTED_SUBSTR="Image memory limit must be greater than 0"
+
+test_start
+
+# the limit must be positive
+run_cmd "$PDFTOEDN --image_memory_limit 0 -o "$TMPFILE" "$TESTDOC""
+status=$?
+
+test_end
+
+flag_set $status $CODE_INIT_ERROR && \
+    check_stdout "$EXPECTED_SUBSTR" && \
+    exit 0
+
+echo "unexpected return value $status"
+exit $status
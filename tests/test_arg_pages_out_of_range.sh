@@ -0,0 +1,22 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+EXPECTED_SUBSTR="Error: requested page number 8 in page list"
+
+test_start
+
+# document has 6 pages - the last range goes past the end. Note page
+# args are 0-indexed
+run_cmd "$PDFTOEDN --pages 0-2,4-8 -o "$TMPFILE" "$TESTDOC""
+status=$?
+
+test_end
+
+flag_set $status $CODE_INIT_ERROR && \
+    check_stdout "$EXPECTED_SUBSTR" && \
+    exit 0
+
+echo "unexpected return value $status"
+exit $status
@@ -34,11 +34,22 @@ test_start () {
 }
 
 # remove contents of :filename and :versions hashes from data output
-# so diff can compare everything else
+# so diff can compare everything else. Output is not newline
+# terminated so one is added - not all seds add it
 filter_meta () {
     local SRC="$1"
     local DST="$2"
-    cat "$SRC" | sed 's/:versions {[a-z0-9:\ \.,_"]*}/:versions {}/' | sed 's/:filename "[a-zA-Z0-9/\_\.\-]*"/:filename ""/' > "$DST"
+    ( cat "$SRC"; echo ) | sed 's/:versions {[a-z0-9:\ \.,_"]*}/:versions {}/' | sed 's/:filename "[a-zA-Z0-9/\_\.\-]*"/:filename ""/' > "$DST"
+}
+
+# rebuilds the single-file output from the meta and page files
+# written with -S so it can be compared to the reference output
+join_shards () {
+    local DIR="$1"
+    local DST="$2"
+    ( sed 's/, :page_files \[[^]]*\]}$/, :pages [/' "$DIR/meta.edn" && \
+      cat "$DIR"/page-*.edn && \
+      printf ']}' ) > "$DST"
 }
 
 # output and execute the command
@@ -46,7 +57,7 @@ run_cmd () {
     local cmd="$@"
 
     # output the command, run it, grab its return code and std-output
-    ( set -x; $cmd &> $STDOUTFILE )
+    ( set -x; $cmd > $STDOUTFILE 2>&1 )
     local status=$?
     cat $STDOUTFILE
     return $status
@@ -45,7 +45,7 @@ do
     filter_meta "$TMPFILE" t1.tmp
 
     # diff them
-    $DIFF t1.tmp "$REFEDN" &> /dev/null
+    $DIFF t1.tmp "$REFEDN" > /dev/null 2>&1
     status=$?
 
     $RM t1.tmp
@@ -0,0 +1,65 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+REFEDN=${TESTS_DIR}/docs/HUN.edn
+
+test_start
+
+# uncompress the reference output if needed
+if [ ! -f "$REFEDN" ]; then
+    $BUNZIP2 "$REFEDN.bz2"
+fi
+
+# compressed output must decompress to the plain output. Formats
+# not built in or without a tool to decompress them are skipped
+status=0
+tested=0
+for format in gzip zstd
+do
+    case $format in
+        gzip) DECOMPRESS="gzip -dc" ;;
+        zstd) DECOMPRESS="zstd -dcq" ;;
+    esac
+
+    if ! which ${DECOMPRESS%% *} > /dev/null 2>&1; then
+        echo " -> No $format tool found - skipping"
+        continue
+    fi
+
+    run_cmd "$PDFTOEDN -f --compress $format -o "$TMPFILE" "$TESTDOC""
+    status=$?
+
+    if [ $status -ne 0 ] && check_stdout "not supported by this build"; then
+        echo " -> $format compression not built - skipping"
+        status=0
+        continue
+    fi
+
+    if [ $status -ne 0 ]; then
+        echo "\tError processing file $TESTDOC"
+        break
+    fi
+
+    $DECOMPRESS "$TMPFILE" > t0.tmp
+    filter_meta t0.tmp t1.tmp
+
+    $DIFF t1.tmp "$REFEDN" > /dev/null 2>&1
+    status=$?
+
+    $RM t0.tmp t1.tmp
+    if [ $status -ne 0 ]; then
+        echo " -> $format output for $TESTDOC did not match reference output $REFEDN"
+        break
+    fi
+    tested=1
+done
+
+test_end
+
+# nothing to test with - report it as skipped
+if [ $status -eq 0 ] && [ $tested -eq 0 ]; then
+    exit 77
+fi
+exit $status
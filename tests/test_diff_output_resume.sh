@@ -0,0 +1,57 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+SHARDDIR=shards_resume.tmp
+REFEDN=${TESTS_DIR}/docs/HUN.edn
+
+test_start
+
+# uncompress the reference output if needed
+if [ ! -f "$REFEDN" ]; then
+    $BUNZIP2 "$REFEDN.bz2"
+fi
+
+run_cmd "$PDFTOEDN -f -S -o "$SHARDDIR" "$TESTDOC""
+status=$?
+
+if [ $status -eq 0 ]; then
+    # simulate a run interrupted after the first 3 pages
+    head -n 3 "$SHARDDIR/pages.journal" > journal.tmp
+    mv journal.tmp "$SHARDDIR/pages.journal"
+    $RM "$SHARDDIR/page-0004.edn" "$SHARDDIR/page-0005.edn" "$SHARDDIR/page-0006.edn"
+
+    # completed pages are told apart by inode and contents as
+    # mtimes may only have 1 second granularity
+    KEPT=`ls -i "$SHARDDIR/page-0001.edn"; cksum "$SHARDDIR/page-0001.edn"`
+
+    run_cmd "$PDFTOEDN -f -S -R -o "$SHARDDIR" "$TESTDOC""
+    status=$?
+fi
+
+if [ $status -eq 0 ]; then
+    # pages in the journal are not written again
+    if [ "`ls -i "$SHARDDIR/page-0001.edn"; cksum "$SHARDDIR/page-0001.edn"`" != "$KEPT" ]; then
+        echo " -> Completed page page-0001.edn was written again"
+        status=1
+    fi
+fi
+
+if [ $status -eq 0 ]; then
+    join_shards "$SHARDDIR" "$TMPFILE"
+    filter_meta "$TMPFILE" t1.tmp
+
+    $DIFF t1.tmp "$REFEDN" > /dev/null 2>&1
+    status=$?
+
+    $RM t1.tmp
+    if [ $status -ne 0 ]; then
+        echo " -> Resumed output for $TESTDOC did not match reference output $REFEDN"
+    fi
+fi
+
+$RM -r "$SHARDDIR"
+test_end
+
+exit $status
@@ -0,0 +1,47 @@
+#!/bin/sh
+
+[ "x${TESTS_DIR}" = "x" ] && TESTS_DIR="."
+. ${TESTS_DIR}/test_common.sh
+
+SHARDDIR=shards.tmp
+REFEDN=${TESTS_DIR}/docs/HUN.edn
+
+test_start
+
+# uncompress the reference output if needed
+if [ ! -f "$REFEDN" ]; then
+    $BUNZIP2 "$REFEDN.bz2"
+fi
+
+# write the meta and each page to separate files
+run_cmd "$PDFTOEDN -f -S -o "$SHARDDIR" "$TESTDOC""
+status=$?
+
+if [ $status -eq 0 ]; then
+    # one file per page, named by its 1-indexed page number
+    for pg in 0001 0002 0003 0004 0005 0006; do
+        if [ ! -f "$SHARDDIR/page-$pg.edn" ]; then
+            echo " -> Missing page file page-$pg.edn"
+            status=1
+        fi
+    done
+fi
+
+if [ $status -eq 0 ]; then
+    # joined, they must match the single-file output
+    join_shards "$SHARDDIR" "$TMPFILE"
+    filter_meta "$TMPFILE" t1.tmp
+
+    $DIFF t1.tmp "$REFEDN" > /dev/null 2>&1
+    status=$?
+
+    $RM t1.tmp
+    if [ $status -ne 0 ]; then
+        echo " -> Page shards for $TESTDOC did not match reference output $REFEDN"
+    fi
+fi
+
+$RM -r "$SHARDDIR"
+test_end
+
+exit $status